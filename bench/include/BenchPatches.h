@@ -0,0 +1,101 @@
+#pragma once
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <juce_events/juce_events.h>
+
+// Hosting helpers and the built-in patches shared by the tools that drive
+// the whole processor
+namespace BenchPatches {
+//! Anything that touches the processor's state (creating it, loading a
+//! patch, setting parameters) goes through the message thread like it would
+//! in a host, only processBlock gets called from the tool's own thread
+template <typename Fn>
+void onMessageThread(Fn&& fn) {
+  juce::WaitableEvent done;
+  juce::MessageManager::callAsync([&] {
+    fn();
+    done.signal();
+  });
+  done.wait();
+}
+
+inline void setParam(juce::AudioProcessor& proc,
+                     const juce::String& id,
+                     float value) {
+  for (auto* p : proc.getParameters()) {
+    if (auto* ranged = dynamic_cast<juce::RangedAudioParameter*>(p)) {
+      if (ranged->getParameterID() == id) {
+        ranged->setValueNotifyingHost(ranged->convertTo0to1(value));
+        return;
+      }
+    }
+  }
+  jassertfalse;  // no parameter with that ID
+}
+
+//! one audible sine operator, the cheapest thing the synth can play
+inline void applySine(juce::AudioProcessor& proc) {
+  setParam(proc, "operatorAudible0", 1.0f);
+}
+
+//! every operator audible and in one modulation chain with feedback, a saw
+//! in the middle and an LFO sweeping a low pass
+inline void applyFm6(juce::AudioProcessor& proc) {
+  const float ratios[] = {1.0f, 2.0f, 3.0f, 1.5f, 0.5f, 4.0f};
+  for (int i = 0; i < 6; ++i) {
+    auto iStr = juce::String(i);
+    setParam(proc, "operatorAudible" + iStr, 1.0f);
+    setParam(proc, "operatorRatio" + iStr, ratios[i]);
+    setParam(proc, "operatorModIndex" + iStr, 200.0f);
+    if (i > 0)
+      setParam(proc, iStr + "to" + juce::String(i - 1) + "Param", 1.0f);
+  }
+  setParam(proc, "0to0Param", 1.0f);
+  setParam(proc, "operatorWaveShape3", 2.0f);  // saw
+  setParam(proc, "filterType", 1.0f);          // low pass
+  setParam(proc, "filterCutoff", 2500.0f);
+  setParam(proc, "filterResonance", 2.0f);
+  setParam(proc, "lfoTarget0", 7.0f);  // filter cutoff
+  setParam(proc, "lfoDepth0", 0.6f);
+  setParam(proc, "lfoRate0", 3.0f);
+}
+
+//! a noise operator modulating a sine, and a noise LFO on the sine's level.
+//! Both noise sources are seeded, so this renders the same every time
+inline void applyNoise(juce::AudioProcessor& proc) {
+  setParam(proc, "operatorAudible0", 1.0f);
+  setParam(proc, "operatorWaveShape1", 4.0f);  // noise
+  setParam(proc, "operatorModIndex0", 40.0f);
+  setParam(proc, "1to0Param", 1.0f);
+  setParam(proc, "lfoWave0", 4.0f);    // noise
+  setParam(proc, "lfoTarget0", 1.0f);  // operator 0 level
+  setParam(proc, "lfoDepth0", 0.5f);
+  setParam(proc, "lfoRate0", 8.0f);
+}
+
+inline juce::StringArray getBuiltInNames() {
+  return {"sine", "fm6", "noise"};
+}
+
+//! sets up one of getBuiltInNames() on top of the processor's default state
+inline void applyBuiltIn(juce::AudioProcessor& proc, const juce::String& name) {
+  if (name == "sine")
+    applySine(proc);
+  else if (name == "fm6")
+    applyFm6(proc);
+  else if (name == "noise")
+    applyNoise(proc);
+  else
+    jassertfalse;
+}
+
+inline bool loadFile(juce::AudioProcessor& proc, const juce::File& file) {
+  // .hxp files hold the same XML as the plugin's saved state
+  auto xml = juce::parseXML(file);
+  if (xml == nullptr)
+    return false;
+  juce::MemoryBlock state;
+  juce::AudioProcessor::copyXmlToBinary(*xml, state);
+  proc.setStateInformation(state.getData(), (int)state.getSize());
+  return true;
+}
+}  // namespace BenchPatches
@@ -0,0 +1,71 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+// Timing and reporting helpers shared by the benchmark executables
+namespace BenchStats {
+inline double ticksToMicros(juce::int64 ticks) {
+  return juce::Time::highResolutionTicksToSeconds(ticks) * 1.0e6;
+}
+
+//! p from 0 to 100, values must already be sorted
+inline double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty())
+    return 0.0;
+  const double pos = (p / 100.0) * (double)(sorted.size() - 1);
+  const auto lo = (size_t)pos;
+  const auto hi = std::min(lo + 1, sorted.size() - 1);
+  return sorted[lo] + ((sorted[hi] - sorted[lo]) * (pos - (double)lo));
+}
+
+//! mean, max and the usual percentiles of a set of timings as a JSON object
+inline juce::var summarize(std::vector<double> values) {
+  std::sort(values.begin(), values.end());
+  double sum = 0.0;
+  for (auto v : values)
+    sum += v;
+  auto* obj = new juce::DynamicObject();
+  obj->setProperty("count", (int)values.size());
+  obj->setProperty("mean", values.empty() ? 0.0 : sum / (double)values.size());
+  obj->setProperty("p50", percentile(values, 50.0));
+  obj->setProperty("p90", percentile(values, 90.0));
+  obj->setProperty("p99", percentile(values, 99.0));
+  obj->setProperty("p999", percentile(values, 99.9));
+  obj->setProperty("max", values.empty() ? 0.0 : values.back());
+  return juce::var(obj);
+}
+
+//! "44100,48000" -> {44100, 48000}, or the fallback if the option wasn't given
+inline std::vector<int> parseIntList(const juce::String& text,
+                                     std::vector<int> fallback) {
+  if (text.isEmpty())
+    return fallback;
+  std::vector<int> values;
+  for (auto& token : juce::StringArray::fromTokens(text, ",", ""))
+    values.push_back(token.trim().getIntValue());
+  return values;
+}
+
+inline juce::StringArray parseNameList(const juce::String& text,
+                                       const juce::StringArray& fallback) {
+  if (text.isEmpty())
+    return fallback;
+  auto names = juce::StringArray::fromTokens(text, ",", "");
+  names.trim();
+  names.removeEmptyStrings();
+  return names;
+}
+
+//! writes the report to the --output file, or stdout if there isn't one
+inline void writeReport(const juce::var& report, const juce::String& path) {
+  const auto json = juce::JSON::toString(report);
+  if (path.isEmpty()) {
+    std::cout << json << std::endl;
+    return;
+  }
+  juce::File(juce::File::getCurrentWorkingDirectory().getChildFile(path))
+      .replaceWithText(json);
+}
+}  // namespace BenchStats
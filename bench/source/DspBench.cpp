@@ -0,0 +1,357 @@
+//===================================================
+// Microbenchmarks for the synth's building blocks, each one timed on its own
+// in ns per sample. Usage:
+//
+//   HexDspBench [--filter=envelope] [--rate=48000] [--samples=4096]
+//               [--reps=200] [--baseline=old.json] [--output=results.json]
+//
+// --filter only runs the kernels with that text in their name, --baseline
+// adds each kernel's speedup over the same kernel in an earlier report. With
+// HEX_RT_CHECK (Debug builds, on by default with the benchmarks) each
+// kernel's run() counts as the audio thread
+#include "Audio/Filter.h"
+#include "Audio/FMOperator.h"
+#include "Audio/LFO.h"
+#include "Audio/ModulationSchedule.h"
+#include "Audio/RealtimeCheck.h"
+#include "BenchStats.h"
+#include <functional>
+#include <optional>
+
+// everything gets summed in here so the compiler can't drop the work
+static volatile float sink = 0.0f;
+
+// One kernel. prepare() runs before every rep and isn't timed, run() is the
+// part being measured and has to process numSamples samples
+struct Kernel {
+  juce::String name;
+  std::function<void()> prepare;
+  std::function<void(int numSamples)> run;
+};
+
+static juce::String waveName(WaveType type) {
+  const char* names[] = {"sine", "square", "saw", "tri", "noise"};
+  return names[(int)type];
+}
+
+//===================================================
+// oscillators
+
+static void addOscillators(std::vector<Kernel>& kernels, double rate) {
+  auto sine = std::make_shared<SineOsc>();
+  sine->setSampleRate(rate);
+  kernels.push_back({"SineOsc::getSample", [] {}, [sine](int n) {
+                       float sum = 0.0f;
+                       for (int i = 0; i < n; ++i)
+                         sum += sine->getSample(440.0);
+                       sink = sink + sum;
+                     }});
+
+  // the high frequency reads a table with far fewer harmonics
+  for (double hz : {110.0, 5000.0}) {
+    auto osc = std::make_shared<AntiAliasOsc>(WaveType::Saw);
+    osc->setSampleRate(rate);
+    kernels.push_back({"AntiAliasOsc::getSample/saw/" + juce::String((int)hz),
+                       [] {}, [osc, hz](int n) {
+                         float sum = 0.0f;
+                         for (int i = 0; i < n; ++i)
+                           sum += osc->getSample(hz);
+                         sink = sink + sum;
+                       }});
+  }
+
+  for (int t = 0; t < 5; ++t) {
+    auto osc = std::make_shared<HexOsc>();
+    osc->setSampleRate(rate);
+    osc->setType((WaveType)t);
+    osc->beginBlock();
+    kernels.push_back({"HexOsc::getSample/" + waveName((WaveType)t), [] {},
+                       [osc](int n) {
+                         float sum = 0.0f;
+                         for (int i = 0; i < n; ++i)
+                           sum += osc->getSample(440.0);
+                         sink = sink + sum;
+                       }});
+  }
+}
+
+//===================================================
+// envelopes
+
+// An envelope set up so that one phase lasts far longer than a rep, and how
+// many samples it takes to get into that phase after triggerOn()
+struct EnvCase {
+  const char* phase;
+  float delayMs, attackMs, holdMs, decayMs, releaseMs;
+  int leadIn;
+  bool trigger;
+  bool letGo;
+};
+
+static void addEnvelopes(std::vector<Kernel>& kernels) {
+  const EnvCase cases[] = {
+      {"delay", 4000.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0, true, false},
+      {"attack", 0.0f, 4000.0f, 0.0f, 0.0f, 0.0f, 1, true, false},
+      {"hold", 0.0f, 0.0f, 8000.0f, 0.0f, 0.0f, 4, true, false},
+      {"decay", 0.0f, 0.0f, 0.0f, 4000.0f, 0.0f, 4, true, false},
+      {"sustain", 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 8, true, false},
+      {"release", 0.0f, 0.0f, 0.0f, 0.0f, 4000.0f, 8, true, true},
+      {"noteOff", 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0, false, false},
+  };
+  for (auto& c : cases) {
+    auto data = std::make_shared<SharedEnvData>();
+    data->setDelay(c.delayMs);
+    data->setAttack(c.attackMs);
+    data->setHold(c.holdMs);
+    data->setDecay(c.decayMs);
+    data->setRelease(c.releaseMs);
+    // publish the segments now rather than waiting for the message loop
+    data->handleUpdateNowIfNeeded();
+    auto env = std::make_shared<std::optional<VoiceEnvelope>>();
+    kernels.push_back({"VoiceEnvelope::process/" + juce::String(c.phase),
+                       [data, env, c] {
+                         env->emplace(data.get());
+                         if (c.trigger)
+                           (*env)->triggerOn(1.0f);
+                         for (int i = 0; i < c.leadIn; ++i)
+                           (*env)->process(1.0f);
+                         if (c.letGo)
+                           (*env)->triggerOff();
+                       },
+                       [env](int n) {
+                         float sum = 0.0f;
+                         for (int i = 0; i < n; ++i)
+                           sum += (*env)->process(1.0f);
+                         sink = sink + sum;
+                       }});
+  }
+}
+
+//===================================================
+// filters
+
+struct FilterBuffers {
+  std::vector<float> left, right, envLevels, lfoMod;
+};
+
+static void addFilters(std::vector<Kernel>& kernels,
+                       double rate,
+                       int maxSamples) {
+  auto luts = std::make_shared<EnvelopeLUTGroup>();
+  const char* typeNames[] = {"none", "lowpass", "highpass", "bandpass"};
+  for (int type = None; type <= BandPass; ++type) {
+    for (bool modulated : {false, true}) {
+      auto filter = std::make_shared<StereoFilter>(luts.get(), 0);
+      filter->setSampleRate(rate);
+      filter->setCutoff(1200.0f);
+      filter->setResonance(4.0f);
+      filter->setDepth(modulated ? 0.5f : 0.0f);
+      filter->setType(type);
+      filter->beginBlock();
+      // a decaying envelope and a 5Hz sweep, or a flat envelope and no
+      // cutoff modulation at all
+      auto bufs = std::make_shared<FilterBuffers>();
+      const auto size = (size_t)maxSamples;
+      bufs->left.resize(size);
+      bufs->right.resize(size);
+      bufs->envLevels.resize(size);
+      bufs->lfoMod.resize(size);
+      for (size_t i = 0; i < size; ++i) {
+        const auto t = (float)i / (float)size;
+        bufs->envLevels[i] = modulated ? 1.0f - t : 0.0f;
+        bufs->lfoMod[i] = 0.5f * std::sin(juce::MathConstants<float>::twoPi *
+                                          5.0f * (float)i / (float)rate);
+      }
+      auto name =
+          "StereoFilter::processBlock/" + juce::String(typeNames[type]);
+      kernels.push_back(
+          {name + (modulated ? "/modulated" : "/static"),
+           [bufs] {
+             juce::Random rng(7);
+             for (size_t i = 0; i < bufs->left.size(); ++i) {
+               bufs->left[i] = (rng.nextFloat() * 2.0f) - 1.0f;
+               bufs->right[i] = (rng.nextFloat() * 2.0f) - 1.0f;
+             }
+           },
+           // the filter's envelope points into luts
+           [luts, filter, bufs, modulated](int n) {
+             filter->processBlock(bufs->left.data(), bufs->right.data(),
+                                  bufs->envLevels.data(),
+                                  modulated ? bufs->lfoMod.data() : nullptr,
+                                  n);
+             sink = sink + bufs->left[(size_t)n - 1];
+           }});
+    }
+  }
+}
+
+//===================================================
+// LFOs
+
+static void addLfos(std::vector<Kernel>& kernels, double rate) {
+  for (int t = Sine; t <= Tri; ++t) {
+    auto lfo = std::make_shared<WaveLfo>((WaveType)t);
+    lfo->setSampleRate(rate);
+    lfo->setRate(5.0f);
+    kernels.push_back({"WaveLfo::tick/" + waveName((WaveType)t), [] {},
+                       [lfo](int n) {
+                         float sum = 0.0f;
+                         for (int i = 0; i < n; ++i)
+                           sum += lfo->tick();
+                         sink = sink + sum;
+                       }});
+  }
+}
+
+//===================================================
+// operators
+
+// all six operators of one voice ticked the same way the voice's scalar
+// path does it, so the cost per sample covers the whole routing
+struct OperatorSet {
+  EnvelopeLUTGroup luts;
+  juce::OwnedArray<FMOperator> ops;
+  ModulationSchedule schedule;
+
+  void tick(double fundamental) {
+    for (int k = 0; k < NUM_OPERATORS; ++k) {
+      auto* op = ops[schedule.order[(size_t)k]];
+      op->clearOffset();
+      for (int e = schedule.edgeStart[(size_t)k];
+           e < schedule.edgeStart[(size_t)k + 1]; ++e)
+        op->addModFrom(*ops[schedule.edges[(size_t)e].src]);
+      op->tick(fundamental);
+    }
+  }
+};
+
+static void addOperators(std::vector<Kernel>& kernels, double rate) {
+  RoutingGrid none = {};
+  RoutingGrid stack = {};
+  for (int o = 1; o < NUM_OPERATORS; ++o)
+    stack[(size_t)o][(size_t)o - 1] = true;
+  RoutingGrid feedback = stack;
+  feedback[0][0] = true;
+  RoutingGrid full;
+  for (auto& row : full)
+    row.fill(true);
+  const std::pair<const char*, RoutingGrid> routings[] = {
+      {"none", none}, {"stack", stack}, {"feedback", feedback}, {"full", full}};
+
+  for (auto& [name, grid] : routings) {
+    auto set = std::make_shared<OperatorSet>();
+    set->schedule = ModulationSchedule::compile(grid);
+    for (int o = 0; o < NUM_OPERATORS; ++o) {
+      auto* op = set->ops.add(new FMOperator(o, &set->luts));
+      op->setSampleRate(rate);
+      op->setRatio((float)(o + 1));
+      op->setModIndex(100.0f);
+      op->setAudible(true);
+      op->trigger(true);
+    }
+    // through the attack and decay so every rep runs at the sustain level
+    for (int i = 0; i < (int)rate / 4; ++i)
+      set->tick(220.0);
+    kernels.push_back({"FMOperator::tick/" + juce::String(name), [] {},
+                       [set](int n) {
+                         for (int i = 0; i < n; ++i)
+                           set->tick(220.0);
+                         sink = sink + set->ops[0]->lastMono();
+                       }});
+  }
+}
+
+//===================================================
+
+static juce::var runKernel(Kernel& k, int samples, int reps) {
+  // a few untimed reps to get the caches and branch predictors warm
+  for (int r = 0; r < 5; ++r) {
+    k.prepare();
+    k.run(samples);
+  }
+  std::vector<double> nsPerSample;
+  nsPerSample.reserve((size_t)reps);
+  RealtimeCheck::resetViolations();
+  for (int r = 0; r < reps; ++r) {
+    k.prepare();
+    const auto start = juce::Time::getHighResolutionTicks();
+    {
+      const RealtimeCheck::ScopedAudioThread rtCheck;
+      k.run(samples);
+    }
+    const auto ticks = juce::Time::getHighResolutionTicks() - start;
+    nsPerSample.push_back(BenchStats::ticksToMicros(ticks) * 1000.0 /
+                          (double)samples);
+  }
+  auto* result = new juce::DynamicObject();
+  result->setProperty("name", k.name);
+  result->setProperty("nsPerSample", BenchStats::summarize(nsPerSample));
+  if (RealtimeCheck::enabled)
+    result->setProperty("rtViolations", (int)RealtimeCheck::getNumViolations());
+  return juce::var(result);
+}
+
+//! the median from a kernel with the same name in an earlier report
+static double baselineFor(const juce::var& baseline, const juce::String& name) {
+  if (auto* results = baseline["results"].getArray()) {
+    for (auto& r : *results) {
+      if (r["name"].toString() == name)
+        return (double)r["nsPerSample"]["p50"];
+    }
+  }
+  return 0.0;
+}
+
+int main(int argc, char* argv[]) {
+  juce::ArgumentList args(argc, argv);
+  // the envelopes publish their segments through the message thread
+  juce::ScopedJuceInitialiser_GUI juceInit;
+  auto opt = [&](const juce::String& name, int fallback) {
+    auto value = args.getValueForOption(name);
+    return value.isEmpty() ? fallback : value.getIntValue();
+  };
+  const int rate = opt("--rate", 48000);
+  const int samples = std::max(opt("--samples", 4096), 1);
+  const int reps = std::max(opt("--reps", 200), 1);
+  const auto filter = args.getValueForOption("--filter");
+  juce::var baseline;
+  const auto baselinePath = args.getValueForOption("--baseline");
+  if (baselinePath.isNotEmpty()) {
+    baseline = juce::JSON::parse(juce::File::getCurrentWorkingDirectory()
+                                     .getChildFile(baselinePath));
+  }
+  // the envelopes work out their lengths from this
+  SampleRate::set((double)rate);
+
+  std::vector<Kernel> kernels;
+  addOscillators(kernels, rate);
+  addEnvelopes(kernels);
+  addFilters(kernels, rate, samples);
+  addLfos(kernels, rate);
+  addOperators(kernels, rate);
+
+  juce::Array<juce::var> results;
+  for (auto& k : kernels) {
+    if (filter.isNotEmpty() && !k.name.containsIgnoreCase(filter))
+      continue;
+    auto result = runKernel(k, samples, reps);
+    const double before = baselineFor(baseline, k.name);
+    if (before > 0.0) {
+      const double now = (double)result["nsPerSample"]["p50"];
+      result.getDynamicObject()->setProperty("speedup", before / now);
+    }
+    std::cerr << k.name << ": " << (double)result["nsPerSample"]["p50"]
+              << " ns/sample" << std::endl;
+    results.add(result);
+  }
+
+  auto* report = new juce::DynamicObject();
+  report->setProperty("benchmark", "HexDspBench");
+  report->setProperty("sampleRate", rate);
+  report->setProperty("samplesPerRep", samples);
+  report->setProperty("reps", reps);
+  report->setProperty("results", results);
+  BenchStats::writeReport(juce::var(report),
+                          args.getValueForOption("--output"));
+  return 0;
+}
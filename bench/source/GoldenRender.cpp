@@ -0,0 +1,455 @@
+//===================================================
+// Golden audio checks for the render engines. Renders a fixed set of patches
+// and MIDI sequences through HexAudioProcessor and compares the results by
+// max abs error, RMS error and log spectral distance. Usage:
+//
+//   HexGoldenRender --record=dir [--engine=block]
+//       renders every case and stores the references in dir
+//   HexGoldenRender --check=dir [--engine=simd]
+//       renders every case and compares it against the references in dir.
+//       CTest runs this against bench/golden for the block and simd engines
+//   HexGoldenRender [--reference=block] [--engines=simd,threaded]
+//       renders every case with each engine and compares it against the
+//       reference engine in the same run
+//
+// Other options: --patches=sine,fm6,noise,file.hxp
+//                --sequences=chord,arpeggio,steal,stealchord
+//                --rate=48000 --block=256
+//                --max-abs=1e-3 --rms=1e-4 --spectral=1.0
+//                --lane-max-abs=2e-2 --lane-rms=2e-3
+//                --output=report.json --rt-strict
+// Exits with 1 if any case fails. In a Debug build with HEX_RT_CHECK (on by
+// default with the benchmarks) the report also counts allocations and locks
+// on the audio thread, --rt-strict makes any of those a failure too. The
+// locks JUCE's Synthesiser and MidiKeyboardState take by design get reported
+// and counted as known violations, which don't fail it.
+#include "PluginProcessor.h"
+#include "Audio/RealtimeCheck.h"
+#include <thread>
+#include "BenchPatches.h"
+#include "BenchStats.h"
+
+//===================================================
+// the engines
+
+// The ways HexSynth can render the same notes. They should all sound the
+// same, except that scalar reads its filter coefficients and block rate mod
+// matrix destinations per sample, so only the spectral check is meaningful
+// for it. simd works out modulated phase increments in float and picks its
+// band-limited tables once per sub-block, so it drifts a little from the
+// others and gets checked against the looser --lane-* limits
+enum class Engine { scalar, block, simd, threaded };
+
+static const juce::StringArray engineNames{"scalar", "block", "simd",
+                                           "threaded"};
+
+//! unknown names get the default, block
+static Engine engineFor(const juce::String& name) {
+  const int idx = engineNames.indexOf(name);
+  return idx < 0 ? Engine::block : (Engine)idx;
+}
+
+//! call on the message thread after prepareToPlay
+static void configureEngine(HexSynth& synth, Engine engine) {
+  synth.setBlockRendering(engine != Engine::scalar);
+  synth.setVoiceBankEnabled(engine == Engine::simd ||
+                            engine == Engine::threaded);
+  synth.setThreadedRendering(engine == Engine::threaded, 2);
+}
+
+//===================================================
+// the MIDI sequences, timed in seconds so they don't depend on the rate
+
+struct TimedEvent {
+  double time;
+  juce::MidiMessage message;
+};
+
+struct Sequence {
+  std::vector<TimedEvent> events;
+  double length;
+};
+
+static void addNote(Sequence& s, double on, double off, int note, float vel) {
+  s.events.push_back({on, juce::MidiMessage::noteOn(1, note, vel)});
+  s.events.push_back({off, juce::MidiMessage::noteOff(1, note)});
+}
+
+static Sequence makeSequence(const juce::String& name) {
+  Sequence s;
+  if (name == "arpeggio") {
+    // overlapping notes with changing velocities
+    const int notes[] = {60, 63, 67, 70, 72};
+    for (int step = 0; step < 16; ++step) {
+      addNote(s, step * 0.1, (step * 0.1) + 0.15, notes[step % 5],
+              0.4f + (0.035f * (float)step));
+    }
+    s.length = 2.5;
+  } else if (name == "steal") {
+    // more notes than voices, so the last ones have to steal
+    for (int n = 0; n < 22; ++n)
+      addNote(s, n * 0.02, 1.0, 40 + (2 * n), 0.7f);
+    s.length = 2.0;
+  } else if (name == "stealchord") {
+    // every voice held, then a chord struck at once. Its notes all have to
+    // steal within the same few samples, before any of the fades finish
+    for (int n = 0; n < NUM_VOICES; ++n)
+      addNote(s, n * 0.01, 1.2, 36 + (2 * n), 0.7f);
+    const int chord[] = {74, 77, 81, 84};
+    for (int n = 0; n < 4; ++n)
+      addNote(s, 0.5, 1.2, chord[n], 0.8f);
+    s.length = 2.0;
+  } else {
+    const int notes[] = {48, 55, 60, 64};
+    for (int n = 0; n < 4; ++n)
+      addNote(s, 0.0, 1.0, notes[n], 0.9f - (0.1f * (float)n));
+    s.length = 2.0;
+  }
+  std::stable_sort(s.events.begin(), s.events.end(),
+                   [](const TimedEvent& a, const TimedEvent& b) {
+                     return a.time < b.time;
+                   });
+  return s;
+}
+
+//===================================================
+// rendering
+
+struct RenderSettings {
+  int rate;
+  int blockSize;
+};
+
+static juce::AudioBuffer<float> render(const juce::String& patch,
+                                       const Sequence& seq,
+                                       Engine engine,
+                                       const RenderSettings& settings) {
+  std::unique_ptr<HexAudioProcessor> proc;
+  BenchPatches::onMessageThread([&] {
+    proc = std::make_unique<HexAudioProcessor>();
+    proc->setPlayConfigDetails(0, 2, (double)settings.rate,
+                               settings.blockSize);
+    if (BenchPatches::getBuiltInNames().contains(patch))
+      BenchPatches::applyBuiltIn(*proc, patch);
+    else
+      BenchPatches::loadFile(*proc, juce::File(patch));
+  });
+  proc->prepareToPlay((double)settings.rate, settings.blockSize);
+  BenchPatches::onMessageThread([&] { configureEngine(proc->synth, engine); });
+
+  juce::AudioBuffer<float> block(2, settings.blockSize);
+  juce::MidiBuffer midi;
+  // pick up the parameters and let the envelopes' async updates land before
+  // the first note, the same number of blocks every time
+  auto settle = [&] {
+    for (int i = 0; i < 32; ++i) {
+      midi.clear();
+      proc->processBlock(block, midi);
+    }
+  };
+  settle();
+  juce::Thread::sleep(100);
+  settle();
+
+  const int length = (int)(seq.length * settings.rate);
+  juce::AudioBuffer<float> output(2, length);
+  size_t next = 0;
+  for (int pos = 0; pos < length; pos += settings.blockSize) {
+    const int numSamples = std::min(settings.blockSize, length - pos);
+    midi.clear();
+    while (next < seq.events.size()) {
+      const auto at = (int)(seq.events[next].time * settings.rate);
+      if (at >= pos + numSamples)
+        break;
+      midi.addEvent(seq.events[next].message, at - pos);
+      ++next;
+    }
+    juce::AudioBuffer<float> view(block.getArrayOfWritePointers(), 2,
+                                  numSamples);
+    proc->processBlock(view, midi);
+    for (int c = 0; c < 2; ++c)
+      output.copyFrom(c, pos, view, c, 0, numSamples);
+  }
+  BenchPatches::onMessageThread([&] { proc.reset(); });
+  return output;
+}
+
+//===================================================
+// reference files
+
+static bool writeWav(const juce::File& file,
+                     const juce::AudioBuffer<float>& buffer,
+                     int rate) {
+  file.deleteFile();
+  std::unique_ptr<juce::OutputStream> stream = file.createOutputStream();
+  if (stream == nullptr)
+    return false;
+  // 32 bit WAVs are stored as floats, so nothing gets lost
+  juce::WavAudioFormat wav;
+  std::unique_ptr<juce::AudioFormatWriter> writer(wav.createWriterFor(
+      stream.get(), (double)rate, 2, 32, {}, 0));
+  if (writer == nullptr)
+    return false;
+  stream.release();
+  return writer->writeFromAudioSampleBuffer(buffer, 0, buffer.getNumSamples());
+}
+
+static bool readWav(const juce::File& file, juce::AudioBuffer<float>& buffer) {
+  juce::WavAudioFormat wav;
+  std::unique_ptr<juce::AudioFormatReader> reader(
+      wav.createReaderFor(file.createInputStream().release(), true));
+  if (reader == nullptr)
+    return false;
+  buffer.setSize((int)reader->numChannels, (int)reader->lengthInSamples);
+  return reader->read(&buffer, 0, buffer.getNumSamples(), 0, true, true);
+}
+
+//===================================================
+// comparing
+
+struct Thresholds {
+  double maxAbs;
+  double rms;
+  double spectralDb;
+};
+
+// The RMS difference in dB between the two signals' magnitude spectra,
+// over 2048 sample Hann windowed frames. Bins that are below -90dB in both
+// are left out so the noise floor doesn't count
+static double spectralDistance(const juce::AudioBuffer<float>& a,
+                               const juce::AudioBuffer<float>& b) {
+  constexpr int order = 11;
+  constexpr int size = 1 << order;
+  juce::dsp::FFT fft(order);
+  juce::dsp::WindowingFunction<float> window(
+      size, juce::dsp::WindowingFunction<float>::hann, false);
+  std::vector<float> fa((size_t)size * 2), fb((size_t)size * 2);
+  const int length = std::min(a.getNumSamples(), b.getNumSamples());
+  const float scale = 4.0f / (float)size;
+  double sum = 0.0;
+  int64_t count = 0;
+  for (int c = 0; c < 2; ++c) {
+    for (int start = 0; start + size <= length; start += size / 2) {
+      std::fill(fa.begin(), fa.end(), 0.0f);
+      std::fill(fb.begin(), fb.end(), 0.0f);
+      std::copy_n(a.getReadPointer(c, start), size, fa.begin());
+      std::copy_n(b.getReadPointer(c, start), size, fb.begin());
+      window.multiplyWithWindowingTable(fa.data(), (size_t)size);
+      window.multiplyWithWindowingTable(fb.data(), (size_t)size);
+      fft.performFrequencyOnlyForwardTransform(fa.data(), true);
+      fft.performFrequencyOnlyForwardTransform(fb.data(), true);
+      for (int bin = 1; bin < size / 2; ++bin) {
+        const auto da = juce::Decibels::gainToDecibels(fa[(size_t)bin] * scale,
+                                                       -120.0f);
+        const auto db = juce::Decibels::gainToDecibels(fb[(size_t)bin] * scale,
+                                                       -120.0f);
+        if (std::max(da, db) < -90.0f)
+          continue;
+        sum += (double)((da - db) * (da - db));
+        ++count;
+      }
+    }
+  }
+  return count > 0 ? std::sqrt(sum / (double)count) : 0.0;
+}
+
+static juce::var compare(const juce::AudioBuffer<float>& reference,
+                         const juce::AudioBuffer<float>& rendered,
+                         const Thresholds& limits) {
+  auto* result = new juce::DynamicObject();
+  const bool sameShape =
+      reference.getNumChannels() == rendered.getNumChannels() &&
+      reference.getNumSamples() == rendered.getNumSamples();
+  double maxAbs = 0.0;
+  double sumSquares = 0.0;
+  if (sameShape) {
+    for (int c = 0; c < reference.getNumChannels(); ++c) {
+      auto* ref = reference.getReadPointer(c);
+      auto* out = rendered.getReadPointer(c);
+      for (int i = 0; i < reference.getNumSamples(); ++i) {
+        const double diff = (double)out[i] - (double)ref[i];
+        maxAbs = std::max(maxAbs, std::abs(diff));
+        sumSquares += diff * diff;
+      }
+    }
+  }
+  const double rms =
+      sameShape ? std::sqrt(sumSquares / (double)(reference.getNumSamples() *
+                                                  reference.getNumChannels()))
+                : 0.0;
+  const double spectral = sameShape ? spectralDistance(reference, rendered)
+                                    : 0.0;
+  const bool passed = sameShape && maxAbs <= limits.maxAbs &&
+                      rms <= limits.rms && spectral <= limits.spectralDb;
+  result->setProperty("sameLength", sameShape);
+  result->setProperty("maxAbsError", maxAbs);
+  result->setProperty("rmsError", rms);
+  result->setProperty("spectralDistanceDb", spectral);
+  result->setProperty("passed", passed);
+  return juce::var(result);
+}
+
+//===================================================
+
+struct Options {
+  juce::StringArray patches;
+  juce::StringArray sequences;
+  RenderSettings settings;
+  Thresholds limits;
+  Thresholds laneLimits;
+  juce::File recordDir;
+  juce::File checkDir;
+  Engine engine;
+  Engine reference;
+  juce::StringArray engines;
+  juce::String outputPath;
+  bool rtStrict;
+};
+
+static juce::String caseName(const juce::String& patch,
+                             const juce::String& sequence) {
+  const auto patchName = juce::File::isAbsolutePath(patch)
+                             ? juce::File(patch).getFileNameWithoutExtension()
+                             : patch;
+  return patchName + "_" + sequence;
+}
+
+//! the limits for comparing a and b
+static const Thresholds& limitsFor(const Options& o, Engine a, Engine b) {
+  const bool lanes = a == Engine::simd || b == Engine::simd;
+  return lanes ? o.laneLimits : o.limits;
+}
+
+static juce::var runCases(const Options& o, bool& allPassed) {
+  juce::Array<juce::var> results;
+  for (auto& patch : o.patches) {
+    for (auto& seqName : o.sequences) {
+      const auto seq = makeSequence(seqName);
+      const auto name = caseName(patch, seqName);
+      auto addResult = [&](juce::var result, const juce::String& engine) {
+        result.getDynamicObject()->setProperty("case", name);
+        result.getDynamicObject()->setProperty("engine", engine);
+        const bool passed = (bool)result["passed"];
+        allPassed = allPassed && passed;
+        std::cerr << (passed ? "pass " : "FAIL ") << name << " (" << engine
+                  << ")" << std::endl;
+        results.add(result);
+      };
+      if (o.recordDir != juce::File()) {
+        auto out = render(patch, seq, o.engine, o.settings);
+        auto file = o.recordDir.getChildFile(name + ".wav");
+        if (!writeWav(file, out, o.settings.rate)) {
+          std::cerr << "couldn't write " << file.getFullPathName()
+                    << std::endl;
+          allPassed = false;
+        }
+      } else if (o.checkDir != juce::File()) {
+        juce::AudioBuffer<float> ref;
+        if (!readWav(o.checkDir.getChildFile(name + ".wav"), ref)) {
+          std::cerr << "no reference for " << name
+                    << ", HexGoldenRecord renders them" << std::endl;
+          allPassed = false;
+          continue;
+        }
+        auto out = render(patch, seq, o.engine, o.settings);
+        // assumes the references were recorded with the default engine
+        addResult(compare(ref, out, limitsFor(o, o.engine, Engine::block)),
+                  engineNames[(int)o.engine]);
+      } else {
+        auto ref = render(patch, seq, o.reference, o.settings);
+        for (auto& engine : o.engines) {
+          auto out = render(patch, seq, engineFor(engine), o.settings);
+          const auto& limits = limitsFor(o, engineFor(engine), o.reference);
+          addResult(compare(ref, out, limits),
+                    engine + " vs " + engineNames[(int)o.reference]);
+        }
+      }
+    }
+  }
+  auto* report = new juce::DynamicObject();
+  report->setProperty("tool", "HexGoldenRender");
+  report->setProperty("sampleRate", o.settings.rate);
+  report->setProperty("blockSize", o.settings.blockSize);
+  report->setProperty("results", results);
+  if (RealtimeCheck::enabled) {
+    const auto violations = (int)RealtimeCheck::getNumViolations();
+    const auto known = (int)RealtimeCheck::getNumKnownViolations();
+    report->setProperty("rtViolations", violations);
+    report->setProperty("rtKnownViolations", known);
+    if (known > 0) {
+      std::cerr << known << " known real-time violations in JUCE's locked code"
+                << std::endl;
+    }
+    if (o.rtStrict && violations > 0) {
+      std::cerr << "FAIL " << violations
+                << " real-time violations on the audio thread" << std::endl;
+      allPassed = false;
+    }
+  }
+  return juce::var(report);
+}
+
+static Options parseOptions(const juce::ArgumentList& args) {
+  auto value = [&](const juce::String& name, const juce::String& fallback) {
+    auto v = args.getValueForOption(name);
+    return v.isEmpty() ? fallback : v;
+  };
+  auto dir = [&](const juce::String& name) {
+    auto v = args.getValueForOption(name);
+    return v.isEmpty()
+               ? juce::File()
+               : juce::File::getCurrentWorkingDirectory().getChildFile(v);
+  };
+  Options o;
+  o.patches = BenchPatches::getBuiltInNames();
+  auto patches = args.getValueForOption("--patches");
+  if (patches.isNotEmpty()) {
+    o.patches.clear();
+    for (auto& p : BenchStats::parseNameList(patches, {})) {
+      const bool builtIn = BenchPatches::getBuiltInNames().contains(p);
+      o.patches.add(builtIn ? p
+                            : juce::File::getCurrentWorkingDirectory()
+                                  .getChildFile(p)
+                                  .getFullPathName());
+    }
+  }
+  o.sequences = BenchStats::parseNameList(
+      args.getValueForOption("--sequences"),
+      {"chord", "arpeggio", "steal", "stealchord"});
+  o.settings = {value("--rate", "48000").getIntValue(),
+                value("--block", "256").getIntValue()};
+  o.limits = {value("--max-abs", "1e-3").getDoubleValue(),
+              value("--rms", "1e-4").getDoubleValue(),
+              value("--spectral", "1.0").getDoubleValue()};
+  o.laneLimits = {value("--lane-max-abs", "2e-2").getDoubleValue(),
+                  value("--lane-rms", "2e-3").getDoubleValue(),
+                  o.limits.spectralDb};
+  o.recordDir = dir("--record");
+  o.checkDir = dir("--check");
+  o.engine = engineFor(value("--engine", "block"));
+  o.reference = engineFor(value("--reference", "block"));
+  o.engines = BenchStats::parseNameList(args.getValueForOption("--engines"),
+                                        {"simd", "threaded"});
+  o.outputPath = args.getValueForOption("--output");
+  o.rtStrict = args.containsOption("--rt-strict");
+  return o;
+}
+
+int main(int argc, char* argv[]) {
+  juce::ArgumentList args(argc, argv);
+  const auto opts = parseOptions(args);
+  if (opts.recordDir != juce::File())
+    opts.recordDir.createDirectory();
+  juce::ScopedJuceInitialiser_GUI juceInit;
+  auto* mm = juce::MessageManager::getInstance();
+  juce::var report;
+  bool allPassed = true;
+  std::thread renderThread([&] {
+    report = runCases(opts, allPassed);
+    mm->stopDispatchLoop();
+  });
+  mm->runDispatchLoop();
+  renderThread.join();
+  BenchStats::writeReport(report, opts.outputPath);
+  return allPassed ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+//===================================================
+// The other half of the plugin's RealtimeCheck: replacements for the calls
+// that aren't real-time safe, which report themselves when they're made
+// inside a ScopedAudioThread. Only the bench tools link this, so only their
+// executables' allocators get replaced. On Linux malloc/free,
+// pthread_mutex_lock and the sleep calls get interposed, elsewhere only the
+// global operator new/delete are replaced
+#include "Audio/RealtimeCheck.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#if HEX_RT_CHECK && defined(__linux__)
+#define HEX_RT_INTERPOSE 1
+#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+// glibc's own allocator, under the names it exports for interposers
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t num, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+}
+#endif
+
+#if HEX_RT_INTERPOSE
+namespace {
+// the next definition of a libc function after ours, looked up on first use.
+// No function-local statics, their guards could end up back in here
+template <typename Fn>
+Fn nextSymbol(std::atomic<Fn>& slot, const char* name) {
+  auto fn = slot.load(std::memory_order_acquire);
+  if (fn == nullptr) {
+    fn = reinterpret_cast<Fn>(dlsym(RTLD_NEXT, name));
+    slot.store(fn, std::memory_order_release);
+  }
+  return fn;
+}
+
+using MutexLockFn = int (*)(pthread_mutex_t*);
+using NanosleepFn = int (*)(const timespec*, timespec*);
+using ClockNanosleepFn = int (*)(clockid_t, int, const timespec*, timespec*);
+using UsleepFn = int (*)(useconds_t);
+std::atomic<MutexLockFn> nextMutexLock;
+std::atomic<NanosleepFn> nextNanosleep;
+std::atomic<ClockNanosleepFn> nextClockNanosleep;
+std::atomic<UsleepFn> nextUsleep;
+
+void check(const char* what) {
+  if (RealtimeCheck::shouldReport())
+    RealtimeCheck::reportViolation(what);
+}
+}  // namespace
+
+// operator new and delete end up in here too, so on Linux these catch every
+// allocation
+extern "C" {
+void* malloc(size_t size) {
+  check("malloc");
+  return __libc_malloc(size);
+}
+
+void* calloc(size_t num, size_t size) {
+  check("calloc");
+  return __libc_calloc(num, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+  check("realloc");
+  return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+  if (ptr != nullptr)
+    check("free");
+  __libc_free(ptr);
+}
+
+// juce::CriticalSection and std::mutex both come through here
+int pthread_mutex_lock(pthread_mutex_t* mutex) {
+  check("pthread_mutex_lock");
+  return nextSymbol(nextMutexLock, "pthread_mutex_lock")(mutex);
+}
+
+int nanosleep(const timespec* duration, timespec* remaining) {
+  check("nanosleep");
+  return nextSymbol(nextNanosleep, "nanosleep")(duration, remaining);
+}
+
+int clock_nanosleep(clockid_t clock,
+                    int flags,
+                    const timespec* duration,
+                    timespec* remaining) {
+  check("clock_nanosleep");
+  return nextSymbol(nextClockNanosleep, "clock_nanosleep")(clock, flags,
+                                                            duration,
+                                                            remaining);
+}
+
+int usleep(useconds_t micros) {
+  check("usleep");
+  return nextSymbol(nextUsleep, "usleep")(micros);
+}
+}
+
+#elif HEX_RT_CHECK
+// the array and sized forms all forward to these
+void* operator new(std::size_t size) {
+  if (RealtimeCheck::shouldReport())
+    RealtimeCheck::reportViolation("operator new");
+  if (auto* ptr = std::malloc(size))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+  if (ptr != nullptr && RealtimeCheck::shouldReport())
+    RealtimeCheck::reportViolation("operator delete");
+  std::free(ptr);
+}
+#endif
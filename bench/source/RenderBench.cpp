@@ -0,0 +1,267 @@
+//===================================================
+// Offline render benchmark for the whole plugin. Drives HexAudioProcessor
+// with synthetic MIDI across a sweep of sample rates, block sizes and voice
+// counts and reports the timings as JSON. Usage:
+//
+//   HexRenderBench [--patch=file.hxp] [--stress=sine,fm6]
+//                  [--rates=44100,48000,96000] [--blocks=32,64,128,256,512]
+//                  [--voices=1,6,12,18] [--scenarios=chords,arpeggio]
+//                  [--seconds=10] [--output=results.json]
+//
+// With the plugin configured with HEX_PROFILE_STAGES=ON each result also
+// breaks the time down by render stage, and in a Debug build with
+// HEX_RT_CHECK (on by default with the benchmarks) it counts allocations and
+// locks on the audio thread, which get printed to stderr with a stack trace
+// as they turn up. The ones inside JUCE's own locked code get counted apart
+#include <juce_audio_processors/juce_audio_processors.h>
+#include <juce_events/juce_events.h>
+#include <thread>
+#include "Audio/RealtimeCheck.h"
+#include "Audio/StageProfiler.h"
+#include "BenchPatches.h"
+#include "BenchStats.h"
+
+// defined by the plugin's shared code
+juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter();
+
+//===================================================
+// the synthetic MIDI
+
+enum class Scenario { chords, arpeggio };
+
+static Scenario scenarioFor(const juce::String& name) {
+  return name == "arpeggio" ? Scenario::arpeggio : Scenario::chords;
+}
+
+// Fills the MIDI for one block. Chords hold numVoices notes for the whole
+// run, the arpeggio strikes a new note every stepSamples and holds each one
+// for numVoices steps so numVoices notes are always down
+struct MidiScript {
+  Scenario scenario;
+  int numVoices;
+  int stepSamples;
+
+  int noteFor(int idx) const { return 36 + ((idx % numVoices) * 4); }
+
+  void fill(juce::MidiBuffer& midi, int64_t start, int numSamples) const {
+    midi.clear();
+    if (scenario == Scenario::chords) {
+      if (start == 0) {
+        for (int n = 0; n < numVoices; ++n)
+          midi.addEvent(juce::MidiMessage::noteOn(1, noteFor(n), 0.8f), 0);
+      }
+      return;
+    }
+    auto step = (start + stepSamples - 1) / stepSamples;
+    for (auto pos = step * stepSamples; pos < start + numSamples;
+         pos += stepSamples, ++step) {
+      const int offset = (int)(pos - start);
+      if (step >= numVoices)
+        midi.addEvent(juce::MidiMessage::noteOff(1, noteFor((int)step)),
+                      offset);
+      midi.addEvent(juce::MidiMessage::noteOn(1, noteFor((int)step), 0.8f),
+                    offset);
+    }
+  }
+};
+
+//===================================================
+
+struct Options {
+  juce::File patchFile;
+  juce::StringArray stressPatches;
+  std::vector<int> rates;
+  std::vector<int> blockSizes;
+  std::vector<int> voiceCounts;
+  juce::StringArray scenarios;
+  double seconds;
+  juce::String outputPath;
+};
+
+class RenderBench {
+public:
+  RenderBench(const Options& o) : opts(o) {}
+
+  juce::var run() {
+    juce::Array<juce::var> results;
+    juce::StringArray patches = opts.stressPatches;
+    if (opts.patchFile != juce::File())
+      patches.add(opts.patchFile.getFullPathName());
+    for (auto& patch : patches) {
+      for (int rate : opts.rates) {
+        // a fresh processor for each rate, the envelopes only work out
+        // their segment lengths when a patch is loaded
+        if (!createProcessor(patch, rate))
+          continue;
+        for (int block : opts.blockSizes) {
+          for (auto& scenario : opts.scenarios) {
+            for (int voices : opts.voiceCounts)
+              results.add(measure(patch, rate, block, scenario, voices));
+          }
+        }
+        BenchPatches::onMessageThread([this] { proc.reset(); });
+      }
+    }
+    auto* report = new juce::DynamicObject();
+    report->setProperty("benchmark", "HexRenderBench");
+    report->setProperty("secondsPerRun", opts.seconds);
+    report->setProperty("results", results);
+    return juce::var(report);
+  }
+
+private:
+  const Options& opts;
+  std::unique_ptr<juce::AudioProcessor> proc;
+  juce::AudioBuffer<float> buffer;
+  juce::MidiBuffer midi;
+
+  static constexpr int maxBlockSize = 4096;
+
+  bool createProcessor(const juce::String& patch, int rate) {
+    bool loaded = true;
+    BenchPatches::onMessageThread([&] {
+      proc.reset(createPluginFilter());
+      proc->setPlayConfigDetails(0, 2, (double)rate, maxBlockSize);
+      if (BenchPatches::getBuiltInNames().contains(patch))
+        BenchPatches::applyBuiltIn(*proc, patch);
+      else
+        loaded = juce::File::isAbsolutePath(patch) &&
+                 BenchPatches::loadFile(*proc, juce::File(patch));
+    });
+    if (!loaded) {
+      std::cerr << "couldn't load patch " << patch << std::endl;
+      BenchPatches::onMessageThread([this] { proc.reset(); });
+      return false;
+    }
+    // the first blocks pick up the new parameters and kick off the
+    // envelopes' async updates, give those a moment to land
+    proc->prepareToPlay((double)rate, 512);
+    buffer.setSize(2, maxBlockSize);
+    renderSilence(rate / 4, 512);
+    juce::Thread::sleep(100);
+    renderSilence(rate / 4, 512);
+    return true;
+  }
+
+  void renderSilence(int numSamples, int blockSize) {
+    for (int done = 0; done < numSamples; done += blockSize) {
+      midi.clear();
+      juce::AudioBuffer<float> view(buffer.getArrayOfWritePointers(), 2,
+                                    blockSize);
+      proc->processBlock(view, midi);
+    }
+  }
+
+  //! lets go of every note and renders until the release tails are over
+  void finishNotes(int rate, int blockSize) {
+    midi.clear();
+    for (int note = 0; note < 128; ++note)
+      midi.addEvent(juce::MidiMessage::noteOff(1, note), 0);
+    juce::AudioBuffer<float> view(buffer.getArrayOfWritePointers(), 2,
+                                  blockSize);
+    proc->processBlock(view, midi);
+    const double tail = std::min(proc->getTailLengthSeconds(), 10.0) + 0.1;
+    renderSilence((int)(tail * rate), blockSize);
+  }
+
+  juce::var measure(const juce::String& patch,
+                    int rate,
+                    int blockSize,
+                    const juce::String& scenarioName,
+                    int voices) {
+    proc->prepareToPlay((double)rate, blockSize);
+    const MidiScript script{scenarioFor(scenarioName), voices, rate / 20};
+    const auto totalSamples = (int64_t)(opts.seconds * rate);
+    std::vector<double> blockMicros;
+    blockMicros.reserve((size_t)(totalSamples / blockSize) + 1);
+    juce::int64 totalTicks = 0;
+    StageProfiler::reset();
+    RealtimeCheck::resetViolations();
+    for (int64_t pos = 0; pos < totalSamples; pos += blockSize) {
+      script.fill(midi, pos, blockSize);
+      juce::AudioBuffer<float> view(buffer.getArrayOfWritePointers(), 2,
+                                    blockSize);
+      const auto start = juce::Time::getHighResolutionTicks();
+      proc->processBlock(view, midi);
+      const auto ticks = juce::Time::getHighResolutionTicks() - start;
+      totalTicks += ticks;
+      blockMicros.push_back(BenchStats::ticksToMicros(ticks));
+    }
+    const auto stages = StageProfiler::toVar();
+    const auto rtViolations = (int)RealtimeCheck::getNumViolations();
+    const auto rtKnown = (int)RealtimeCheck::getNumKnownViolations();
+    finishNotes(rate, blockSize);
+
+    const double wallSeconds =
+        juce::Time::highResolutionTicksToSeconds(totalTicks);
+    const double audioSeconds = (double)totalSamples / (double)rate;
+    const double cpuPercent = 100.0 * wallSeconds / audioSeconds;
+    auto* result = new juce::DynamicObject();
+    const bool isFile = juce::File::isAbsolutePath(patch);
+    result->setProperty("patch",
+                        isFile ? juce::File(patch).getFileName() : patch);
+    result->setProperty("sampleRate", rate);
+    result->setProperty("blockSize", blockSize);
+    result->setProperty("scenario", scenarioName);
+    result->setProperty("voices", voices);
+    result->setProperty("realTimeFactor", audioSeconds / wallSeconds);
+    result->setProperty("cpuPercent", cpuPercent);
+    result->setProperty("cpuPercentPerVoice", cpuPercent / (double)voices);
+    result->setProperty("blockBudgetMicros",
+                        1.0e6 * (double)blockSize / (double)rate);
+    result->setProperty("blockMicros", BenchStats::summarize(blockMicros));
+    // only there when the plugin was built with HEX_PROFILE_STAGES
+    if (StageProfiler::enabled)
+      result->setProperty("stages", stages);
+    if (RealtimeCheck::enabled) {
+      result->setProperty("rtViolations", rtViolations);
+      result->setProperty("rtKnownViolations", rtKnown);
+    }
+    return juce::var(result);
+  }
+};
+
+//===================================================
+
+static Options parseOptions(const juce::ArgumentList& args) {
+  Options o;
+  auto patch = args.getValueForOption("--patch");
+  if (patch.isNotEmpty())
+    o.patchFile = juce::File::getCurrentWorkingDirectory().getChildFile(patch);
+  // the stress patches only run by default when there's no patch file
+  const juce::StringArray defaultStress =
+      patch.isEmpty() ? juce::StringArray{"sine", "fm6"} : juce::StringArray{};
+  o.stressPatches = BenchStats::parseNameList(
+      args.getValueForOption("--stress"), defaultStress);
+  o.rates = BenchStats::parseIntList(args.getValueForOption("--rates"),
+                                     {44100, 48000, 96000});
+  o.blockSizes = BenchStats::parseIntList(args.getValueForOption("--blocks"),
+                                          {32, 64, 128, 256, 512});
+  o.voiceCounts = BenchStats::parseIntList(args.getValueForOption("--voices"),
+                                           {1, 6, 12, 18});
+  o.scenarios = BenchStats::parseNameList(
+      args.getValueForOption("--scenarios"), {"chords", "arpeggio"});
+  auto seconds = args.getValueForOption("--seconds");
+  o.seconds = seconds.isEmpty() ? 10.0 : seconds.getDoubleValue();
+  o.outputPath = args.getValueForOption("--output");
+  return o;
+}
+
+int main(int argc, char* argv[]) {
+  juce::ArgumentList args(argc, argv);
+  const auto opts = parseOptions(args);
+  juce::ScopedJuceInitialiser_GUI juceInit;
+  auto* mm = juce::MessageManager::getInstance();
+  juce::var report;
+  // the message thread stays on main, the benchmark runs beside it like a
+  // host's audio thread
+  std::thread benchThread([&] {
+    RenderBench bench(opts);
+    report = bench.run();
+    mm->stopDispatchLoop();
+  });
+  mm->runDispatchLoop();
+  benchThread.join();
+  BenchStats::writeReport(report, opts.outputPath);
+  return 0;
+}
@@ -48,37 +48,75 @@ void setTrackingAmount(float amt);
 float gainForVelocity(float vel);
 }  // namespace VelTracking
 
-constexpr size_t MAX_LUT_SIZE =
-    (size_t)((RELEASE_MAX / 1000.0f) * MAX_SAMPLE_RATE);
-
-typedef std::array<float, MAX_LUT_SIZE> lut_array_t;
-
-// this object should only be instantiated once per operator,
-// voices will need a pointer to it
-class SharedEnvData : public juce::AsyncUpdater {
-private:
-  juce::CriticalSection critSection;
-  float delayMs = DELAY_DEFAULT;
-  float attackMs = ATTACK_DEFAULT;
-  float holdMs = HOLD_DEFAULT;
-  float decayMs = DECAY_DEFAULT;
-  float sustainLevel = SUSTAIN_DEFAULT;
-  float releaseMs = RELEASE_DEFAULT;
-
+// the attack/decay/release stages all trace the same curve (x^e, forwards
+// for the attack and backwards for the decay/release) at different speeds,
+// so rather than a LUT per stage there's one small table of that curve shared
+// by every envelope, read with linear interpolation (max error < 1e-5 against
+// the exact curve). Memory no longer depends on the length of the stage.
+namespace EnvCurve {
+constexpr size_t TABLE_SIZE = 256;
+//! the curve at x in [0, 1]
+float at(float x);
+//! the inverse of the curve, for finding where a level sits on the attack
+float inverse(float level);
+}  // namespace EnvCurve
+
+// one complete, immutable set of envelope segments. SharedEnvData never
+// changes a published set, it builds a new one and swaps the pointer
+struct EnvSegments {
   size_t delaySamples;
   size_t attackSamples;
   size_t holdSamples;
   size_t decaySamples;
   size_t releaseSamples;
+  // 1 / length of each curved stage, i.e. the curve position per sample
+  float attackStep;
+  float decayStep;
+  float releaseStep;
+  float sustainLevel;
+};
 
-  lut_array_t attackLut;
-  lut_array_t decayLut;
-  lut_array_t releaseLut;
-
-  void computeLUTs();
+// this object should only be instantiated once per operator,
+// voices will need a pointer to it
+class SharedEnvData : public juce::AsyncUpdater {
+private:
+  // written by the param setters on the audio thread, read when a new
+  // segment set gets built
+  std::atomic<float> delayMs = DELAY_DEFAULT;
+  std::atomic<float> attackMs = ATTACK_DEFAULT;
+  std::atomic<float> holdMs = HOLD_DEFAULT;
+  std::atomic<float> decayMs = DECAY_DEFAULT;
+  std::atomic<float> sustainLevel = SUSTAIN_DEFAULT;
+  std::atomic<float> releaseMs = RELEASE_DEFAULT;
+
+  // the published segments, only ever swapped on the message thread
+  std::atomic<const EnvSegments*> segments;
+  // a set replaced while the audio thread was inside a block waits here
+  // until that block is over, so nothing gets freed while a voice might be
+  // reading it
+  struct Retired {
+    std::unique_ptr<const EnvSegments> data;
+    uint64_t epoch;
+  };
+  std::vector<Retired> retired;
+  // bumped at the start and the end of each of the owning synth's blocks,
+  // so it's odd while a block is running
+  std::atomic<uint64_t> audioEpoch{0};
+
+  EnvSegments computeSegments() const;
+  void publishSegments();
+  void setParam(std::atomic<float>& param, float value);
 
 public:
   SharedEnvData();
+  ~SharedEnvData() override;
+  //! call from the owning synth's audio thread around every block, before
+  //! any envelope gets processed and after the last one. Voices mustn't hold
+  //! on to an EnvSegments pointer from one block to the next
+  void beginAudioBlock() { audioEpoch.fetch_add(1); }
+  void endAudioBlock() { audioEpoch.fetch_add(1); }
+  //! the current set, only valid until the end of the block
+  const EnvSegments& getSegments() const { return *segments.load(); }
   // param setters
   void setDelay(float delay);
   void setAttack(float attack);
@@ -86,16 +124,30 @@ public:
   void setDecay(float decay);
   void setSustain(float lvl);
   void setRelease(float release);
+  //! safe from any thread
+  float getRelease() const { return releaseMs.load(std::memory_order_relaxed); }
   size_t sampleIdxForRetrig(float level) const;
   // notice that this takes references because it handles updating for
   // the per-voice objects
-  float nextValue(EnvPhase& phase, size_t& samplesInPhase) const;
-  void handleAsyncUpdate() override { computeLUTs(); }
+  static float nextValue(const EnvSegments& seg,
+                         EnvPhase& phase,
+                         size_t& samplesInPhase);
+  void handleAsyncUpdate() override { publishSegments(); }
 };
 
 struct EnvelopeLUTGroup {
   SharedEnvData operatorEnv[NUM_OPERATORS];
   SharedEnvData filterEnv;
+  void beginAudioBlock() {
+    for (auto& env : operatorEnv)
+      env.beginAudioBlock();
+    filterEnv.beginAudioBlock();
+  }
+  void endAudioBlock() {
+    for (auto& env : operatorEnv)
+      env.endAudioBlock();
+    filterEnv.endAudioBlock();
+  }
 };
 
 // the per-voice objects for the envelope implementations
@@ -114,9 +166,21 @@ public:
   void triggerOn(float velocity);
   void triggerOff();
   float process(float input);
+  //! advances the envelope by numSamples and writes the level for each sample
+  //! to dest, identical to calling process(1.0f) numSamples times
+  void renderLevels(float* dest, int numSamples);
   float getLastLevel() const { return lastLevel; }
   bool isActive() const { return !(currentPhase == noteOff); }
+  //! finished and faded all the way out, stays at 0 until triggered again
+  bool isSilent() const { return currentPhase == noteOff && lastLevel == 0.0f; }
+  //! fades out over a few ms from wherever the level is and then stays
+  //! silent until the next triggerOn()
   void killQuick();
+  //! straight to silent and finished, wherever it was
+  void reset();
+
+private:
+  void stepKillQuick();
 };
 
 //===============================================================
@@ -13,6 +13,8 @@
 #include "DAHDSR.h"
 #define NUM_VOICES 18
 #define NUM_LFOS 4
+// number of samples the block renderer processes per stage pass
+#define VOICE_SUB_BLOCK 32
 //! macros for use in parameter layout
 #define RATIO_MIN 0.1f
 #define RATIO_MAX 10.0f
@@ -40,13 +42,42 @@ public:
   }
   void setSampleRate(double rate);
   //! functions to set private variables
-  void setRatio(float value) { baseRatio = value; }
-  void setModIndex(float value) { modIndex = value; }
-  void setPan(float value) { pan = value; }
+  void setRatio(float value) {
+    ratioParam = value;
+    updateRatio();
+  }
+  void setModIndex(float value) {
+    modIndexParam = value;
+    updateModIndex();
+  }
+  void setPan(float value) {
+    panParam = value;
+    updatePan();
+  }
+  //! block rate offsets from the mod matrix on top of the parameter values,
+  //! in octaves for the ratio and parameter units for the others
+  void setRatioMod(float octaves) {
+    ratioMod = octaves;
+    updateRatio();
+  }
+  void setModIndexMod(float offset) {
+    modIndexMod = offset;
+    updateModIndex();
+  }
+  void setPanMod(float offset) {
+    panMod = offset;
+    updatePan();
+  }
   void setLevel(float value) { level = value; }
   void setAudible(bool shouldBeAudible) { audible = shouldBeAudible; }
   void clearOffset() { modOffset = 0.0f; }
   float getLevel() const { return level; }
+  float getPan() const { return pan; }
+  float getRatio() const { return baseRatio; }
+  float getModIndex() const { return modIndex; }
+  //! lets the VoiceBank hand back the last output it computed for this
+  //! operator so the next sample's modulation picks it up
+  void setLastMono(float value) { lastOutMono = value; }
 
 private:
   bool audible;
@@ -62,12 +93,44 @@ public:
   void addModFrom(const FMOperator& source) { modOffset += source.lastMono(); }
   void tick(double fundamental);
   void tick(double fundamental, float modValue);
+  //! tick() at a gain that already has the LFO and mod matrix folded in
+  void tickAtGain(double fundamental, float gain);
+  //! block renderer counterpart to tick(): the voice computes the LFO-scaled
+  //! level and the envelope level for each sample ahead of time
+  float tickWithGains(double fundamental, float gain, float envLevel) {
+    lastOutMono =
+        (oscillator.getSample((fundamental * baseRatio) +
+                              (modIndex * modOffset)) *
+         gain) *
+        envLevel;
+    return lastOutMono;
+  }
+  //! renders a whole block with the oscillator's block API, only valid when
+  //! no operator modulates any other (nothing needs lastMono() mid-block)
+  void renderUnmodulated(float* dest,
+                         double fundamental,
+                         const float* gains,
+                         const float* envLevels,
+                         int numSamples);
   void setWave(int type) { oscillator.setType((WaveType)type); }
   HexOsc oscillator;
   VoiceEnvelope vEnv;
 
 private:
+  void updateRatio() { baseRatio = ratioParam * std::exp2(ratioMod); }
+  void updateModIndex() {
+    modIndex = std::clamp(modIndexParam + modIndexMod, MODINDEX_MIN,
+                          MODINDEX_MAX);
+  }
+  void updatePan() { pan = std::clamp(panParam + panMod, PAN_MIN, PAN_MAX); }
   //! Settable parameters stored down here
+  float ratioParam;
+  float modIndexParam;
+  float panParam;
+  float ratioMod;
+  float modIndexMod;
+  float panMod;
+  //! the above combined, what the render code reads
   float modIndex;
   float baseRatio;
   float modOffset;
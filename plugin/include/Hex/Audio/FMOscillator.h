@@ -12,6 +12,8 @@
 #include "HexHeader.h"
 #define TABLES_PER_FRAME 10
 #define TABLESIZE 2048
+// log2(TABLESIZE), the number of phase bits used for the table index
+#define TABLE_BITS 11
 
 struct Wavetable {
   float table[TABLESIZE];
@@ -21,56 +23,144 @@ struct Wavetable {
 
 namespace WTArray {
 std::array<float, TABLESIZE> makeArray(WaveType type);
+//! one cycle of sine shared by every SineOsc in the process, built the
+//! first time this gets called
+const float* getSharedSine();
 }
 
-class SineOsc {
+// the band-limited mip-mapped tables for one waveform. These never change
+// once they're built, so every oscillator in the process shares the same set
+// for each WaveType and switching waveforms is just a pointer swap
+class WaveTableSet : public juce::ReferenceCountedObject {
 public:
-  SineOsc();
-  float getSample(double hz);
+  using Ptr = juce::ReferenceCountedObjectPtr<const WaveTableSet>;
+  //! the shared set for Square, Saw or Tri, sine and noise don't use one.
+  //! All three get built the first time this is called, so make sure that's
+  //! not on the audio thread
+  static Ptr get(WaveType type);
+  int getNumTables() const { return numTables; }
+  const Wavetable* getTable(int idx) const { return &tables[idx]; }
+  //! the table to use for a phase delta (i.e. hz / sampleRate)
+  const Wavetable* tableForDelta(float phaseDelta) const;
+
+private:
+  WaveTableSet(WaveType type);
+  void createTables(int size, float* real, float* imag);
+  float makeTable(float* waveReal,
+                  float* waveImag,
+                  int numSamples,
+                  float scale,
+                  float bottomFreq,
+                  float topFreq);
+  Wavetable tables[TABLES_PER_FRAME];
+  int numTables;
+};
+
+enum class OscInterpolation { linear, cubic };
+
+// 32 bit fixed point phase, the full range of a uint32_t is one cycle so
+// wrapping around is free. The top TABLE_BITS bits are the table index and
+// the rest are the fraction between that and the next point
+class PhaseAccumulator {
+public:
+  static constexpr int fracBits = 32 - TABLE_BITS;
   void setSampleRate(double rate) {
     sampleRate = rate;
-    nyquist = sampleRate / 2.0f;
+    nyquist = sampleRate / 2.0;
+    lastHz = -1.0;
   }
+  //! returns true if the increment had to be recomputed
+  bool setFrequency(double hz) {
+    if (hz == lastHz)
+      return false;
+    lastHz = hz;
+    hz = std::clamp(hz, 10.0, nyquist);
+    increment = (uint32_t)((hz / sampleRate) * 4294967296.0);
+    return true;
+  }
+  uint32_t next() {
+    phase += increment;
+    return phase;
+  }
+  uint32_t getIncrement() const { return increment; }
+  uint32_t getPhase() const { return phase; }
+  void setPhase(uint32_t value) { phase = value; }
+
+private:
+  double sampleRate = 44100.0;
+  double nyquist = 22050.0;
+  double lastHz = -1.0;
+  uint32_t phase = 0;
+  uint32_t increment = 0;
+};
+
+namespace TableRead {
+//! read a TABLESIZE-long single cycle table at a fixed point phase
+float linear(const float* table, uint32_t phase);
+float cubic(const float* table, uint32_t phase);
+inline float read(const float* table, uint32_t phase, OscInterpolation mode) {
+  return (mode == OscInterpolation::cubic) ? cubic(table, phase)
+                                           : linear(table, phase);
+}
+}  // namespace TableRead
+
+class SineOsc {
+public:
+  SineOsc();
+  float getSample(double hz);
+  //! block versions of getSample, for a fixed or a per-sample frequency
+  void renderBlock(float* dest, int numSamples, double hz);
+  void renderBlock(float* dest, const float* hz, int numSamples);
+  void setSampleRate(double rate) { acc.setSampleRate(rate); }
+  void setInterpolation(OscInterpolation mode) { interp = mode; }
+  OscInterpolation getInterpolation() const { return interp; }
+  //! state access for the VoiceBank's vectorised operator stage
+  uint32_t getPhase() const { return acc.getPhase(); }
+  void setPhase(uint32_t value) { acc.setPhase(value); }
+  const float* getTable() const { return sineData; }
 
 private:
-  double sampleRate;
-  double nyquist;
-  float phase;
-  float phaseDelta;
-  float skew;
-  int lowerIdx;
-  int upperIdx;
-  float sineData[TABLESIZE];
+  PhaseAccumulator acc;
+  OscInterpolation interp = OscInterpolation::linear;
+  const float* sineData;
 };
 
 class AntiAliasOsc {
 public:
   AntiAliasOsc(WaveType type = WaveType::Square);
   float getSample(double hz);
-  void createTables(int size, float* real, float* imag);
-  float makeTable(float* waveReal,
-                  float* waveImag,
-                  int numSamples,
-                  float scale,
-                  float bottomFreq,
-                  float topFreq);
-  Wavetable* tableForHz(double hz);
+  void renderBlock(float* dest, int numSamples, double hz);
+  void renderBlock(float* dest, const float* hz, int numSamples);
+  //! swaps in the shared tables for a different waveform
+  void setWaveType(WaveType type);
   void setSampleRate(double rate) {
     sampleRate = rate;
-    nyquist = sampleRate / 2.0f;
+    acc.setSampleRate(rate);
+  }
+  void setInterpolation(OscInterpolation mode) { interp = mode; }
+  OscInterpolation getInterpolation() const { return interp; }
+  //! state access for the VoiceBank's vectorised operator stage
+  uint32_t getPhase() const { return acc.getPhase(); }
+  void setPhase(uint32_t value) { acc.setPhase(value); }
+  //! the band-limited table it would read for a steady hz
+  const float* getTableFor(double hz) const {
+    const double delta = std::clamp(hz, 10.0, sampleRate / 2.0) / sampleRate;
+    return tables->tableForDelta((float)delta)->table;
   }
 
 private:
+  //! the band-limited table only changes along with the frequency
+  void setFrequency(double hz) {
+    if (acc.setFrequency(hz)) {
+      currentTable =
+          tables->tableForDelta((float)(acc.getIncrement() / 4294967296.0));
+    }
+  }
   double sampleRate = 44100.0;
-  double nyquist = sampleRate / 2.0;
-  juce::OwnedArray<Wavetable> tables;
-  float phase;
-  float phaseDelta;
-  int tablesAdded;
-  int bottomIndex;
-  // float bSample;
-  // float tSample;
-  // float skew;
+  PhaseAccumulator acc;
+  OscInterpolation interp = OscInterpolation::linear;
+  WaveTableSet::Ptr tables;
+  const Wavetable* currentTable;
 };
 
 class NoiseOsc {
@@ -89,21 +179,42 @@ private:
   juce::Random rGen;
 };
 
-class HexOsc : public juce::AsyncUpdater {
+class HexOsc {
 private:
   enum OscModeE { mSine, mWave, mNoise };
   OscModeE oMode = OscModeE::mSine;
 
 public:
   HexOsc();
-  void handleAsyncUpdate() override;
-  void setType(WaveType type);
+  //! safe from any thread, the new type takes over at the next beginBlock()
+  void setType(WaveType type) {
+    requestedType.store((int)type, std::memory_order_relaxed);
+  }
+  //! switches to the type last passed to setType(). Call this at a block
+  //! boundary on the thread doing the rendering. Every mode is a member and
+  //! the tables are shared, so this never allocates
+  void beginBlock();
   void setSampleRate(double rate);
   float getSample(double hz);
+  //! the VoiceBank can only vectorise the table-based modes
+  bool isSineMode() const { return oMode == OscModeE::mSine; }
+  bool isWaveMode() const { return oMode == OscModeE::mWave; }
+  void setInterpolation(OscInterpolation mode) {
+    sineOsc.setInterpolation(mode);
+    waveOsc.setInterpolation(mode);
+  }
+  OscInterpolation getInterpolation() const {
+    return sineOsc.getInterpolation();
+  }
+  //! fills dest with numSamples samples at a fixed frequency
+  void renderBlock(float* dest, int numSamples, double hz);
+  SineOsc& getSineOsc() { return sineOsc; }
+  AntiAliasOsc& getWaveOsc() { return waveOsc; }
 
 private:
+  std::atomic<int> requestedType;
   WaveType currentType;
   SineOsc sineOsc;
-  std::unique_ptr<AntiAliasOsc> waveOsc;
+  AntiAliasOsc waveOsc;
   NoiseOsc nOsc;
 };
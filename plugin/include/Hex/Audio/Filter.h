@@ -13,6 +13,7 @@
 #include <cstdint>
 #include "DAHDSR.h"
 #include "MathUtil.h"
+#include "SVFLanes.h"
 #include "juce_core/juce_core.h"
 #define CUTOFF_MIN 20.0f
 #define CUTOFF_MAX 20000.0f
@@ -25,210 +26,143 @@
 #define RESONANCE_CENTER 5.0f
 enum FilterType { None, LoPass, HiPass, BandPass };
 
-class FilterCore {
-public:
-  FilterCore()
-      : sampleRate(44100.0f), cutoff(2500.0f), resonance(1.0f), blockSize(512) {
-    setup();
-  }
-  virtual ~FilterCore() {}
-  virtual float process(float input) {
-    juce::ignoreUnused(input);
-    return 0.0f;
-  }
-  virtual float processWithMod(float input, float modValue) {
-    setup(modValue);
-    return process(input);
-  }
-  virtual void setup() {}
-  virtual void setup(float modValue) { juce::ignoreUnused(modValue); }
-  virtual void setResonance(float value) {
-    resonance = value;
-    setup();
-  }
-  virtual void setCutoff(float value) {
-    cutoff = value;
-    setup();
-  }
-  virtual void setSampleRate(double rate, int block = 512) {
-    sampleRate = rate;
-    blockSize = block;
-    setup();
-  }
-
-protected:
-  double sampleRate;
-  float cutoff;
-  float resonance;
-  int blockSize;
+// Coefficients for a TPT (topology preserving transform) state variable
+// filter, as in Zavalishin's "The Art of VA Filter Design"
+struct SVFCoefficients {
+  float g = 0.0f;   // tan(pi * cutoff / sampleRate)
+  float r2 = 1.0f;  // 1 / resonance
+  float h = 1.0f;   // 1 / (1 + r2 * g + g * g)
+  static SVFCoefficients make(float cutoff, float resonance, double sampleRate);
 };
 
-class LibLowPass : public FilterCore {
+// The state and coefficients for one voice's two channel SVF. The
+// coefficients get computed at control rate and ramped linearly between
+// updates, the integrators keep their state when the coefficients change so
+// a modulated cutoff never resets the filter. The block path runs through
+// the SVFLanes kernel with left and right as a pair of lanes
+class StereoSVF {
 public:
-  void setup() override {
-    // filter.setup (sampleRate, (double)cutoff, (double)resonance);
-    juce::dsp::ProcessSpec spec;
-    spec.sampleRate = sampleRate;
-    spec.maximumBlockSize = (uint32_t)blockSize;
-    spec.numChannels = 1;
-    jFilter.prepare(spec);
-    jFilter.setCutoffFrequency(cutoff);
-    jFilter.setResonance(resonance);
-    jFilter.setType(juce::dsp::StateVariableTPTFilterType::lowpass);
-  }
-  void setup(float modValue) override {
-    // filter.setup (sampleRate, (double)cutoff + ((CUTOFF_MAX - cutoff) *
-    // modValue), (double)resonance);
-    juce::dsp::ProcessSpec spec;
-    spec.sampleRate = sampleRate;
-    spec.maximumBlockSize = (uint32_t)blockSize;
-    spec.numChannels = 1;
-    jFilter.prepare(spec);
-    jFilter.setCutoffFrequency(cutoff + ((CUTOFF_MAX - cutoff) * modValue));
-    jFilter.setResonance(resonance);
-    jFilter.setType(juce::dsp::StateVariableTPTFilterType::lowpass);
-  }
-  float process(float input) override {
-    return jFilter.processSample(0, input);
-  }
-
-private:
-  // Iir::RBJ::LowPass filter;
-  juce::dsp::StateVariableTPTFilter<float> jFilter;
-};
-
-class LibHiPass : public FilterCore {
-public:
-  void setup() override {
-    // filter.setup (sampleRate, (double)cutoff, (double)resonance);
-    juce::dsp::ProcessSpec spec;
-    spec.sampleRate = sampleRate;
-    spec.maximumBlockSize = (uint32_t)blockSize;
-    spec.numChannels = 1;
-    jFilter.prepare(spec);
-    jFilter.setCutoffFrequency(cutoff);
-    jFilter.setResonance(resonance);
-    jFilter.setType(juce::dsp::StateVariableTPTFilterType::highpass);
-  }
-  float process(float input) override {
-    return jFilter.processSample(0, input);
-  }
-  void setup(float modValue) override {
-    // filter.setup (sampleRate, (double)cutoff + ((CUTOFF_MAX - cutoff) *
-    // modValue), (double)resonance);
-    juce::dsp::ProcessSpec spec;
-    spec.sampleRate = sampleRate;
-    spec.maximumBlockSize = (uint32_t)blockSize;
-    spec.numChannels = 1;
-    jFilter.prepare(spec);
-    jFilter.setCutoffFrequency(cutoff + ((CUTOFF_MAX - cutoff) * modValue));
-    jFilter.setResonance(resonance);
-    jFilter.setType(juce::dsp::StateVariableTPTFilterType::highpass);
-  }
-
-private:
-  // Iir::RBJ::HighPass filter;
-  juce::dsp::StateVariableTPTFilter<float> jFilter;
-};
-
-class LibBandPass : public FilterCore {
-public:
-  void setup() override {
-    // filter.setup (sampleRate, (double)cutoff, (double)resonance);
-    juce::dsp::ProcessSpec spec;
-    spec.sampleRate = sampleRate;
-    spec.maximumBlockSize = (uint32_t)blockSize;
-    spec.numChannels = 1;
-    jFilter.prepare(spec);
-    jFilter.setCutoffFrequency(cutoff);
-    jFilter.setResonance(resonance);
-    jFilter.setType(juce::dsp::StateVariableTPTFilterType::bandpass);
-  }
-
-  void setup(float modValue) override {
-    // filter.setup (sampleRate, (double)cutoff + ((CUTOFF_MAX - cutoff) *
-    // modValue), (double)resonance);
-    juce::dsp::ProcessSpec spec;
-    spec.sampleRate = sampleRate;
-    spec.maximumBlockSize = (uint32_t)blockSize;
-    spec.numChannels = 1;
-    jFilter.prepare(spec);
-    jFilter.setCutoffFrequency(cutoff + ((CUTOFF_MAX - cutoff) * modValue));
-    jFilter.setResonance(resonance);
-    jFilter.setType(juce::dsp::StateVariableTPTFilterType::bandpass);
-  }
-
-  float process(float input) override {
-    return jFilter.processSample(0, input);
-  }
+  //! samples between coefficient updates in StereoFilter::processBlock
+  static constexpr int controlInterval = SVFLanes::maxSegment;
+  void setSampleRate(double rate) {
+    sampleRate = rate;
+    reset();
+  }
+  void setType(FilterType type) { currentType = type; }
+  //! clears the filter state, the next rampTo() jumps straight to its target
+  void reset();
+  //! start moving the coefficients towards the ones for this cutoff and
+  //! resonance, getting there after numSamples samples
+  void rampTo(float cutoff, float resonance, int numSamples);
+  //! jump straight to the coefficients, for the per-sample reference path
+  void setImmediate(float cutoff, float resonance);
+  //! copies the state and the current ramp into the left and right lanes
+  //! firstLane and firstLane + 1
+  void loadLanes(SVFLanes::Data& d, int firstLane, float wetLevel) const;
+  //! takes the state back after SVFLanes::process and finishes the ramp
+  void storeLanes(const SVFLanes::Data& d, int firstLane);
+  //! one sample of each channel at the current coefficients
+  void processSample(float& left, float& right, float wetLevel);
 
 private:
-  // Iir::RBJ::BandPass1 filter;
-  juce::dsp::StateVariableTPTFilter<float> jFilter;
+  template <FilterType type>
+  float tick(int channel, float input);
+  double sampleRate = 44100.0;
+  FilterType currentType = LoPass;
+  SVFCoefficients coeffs;
+  SVFCoefficients target;
+  SVFCoefficients delta;
+  bool primed = false;
+  float s1[2] = {0.0f, 0.0f};
+  float s2[2] = {0.0f, 0.0f};
 };
 
-class StereoFilter : public juce::AsyncUpdater {
+class StereoFilter {
 public:
   StereoFilter(EnvelopeLUTGroup* luts, int voiceIdx);
   void setSampleRate(double rate, int blockSize = 512) {
     juce::ignoreUnused(blockSize);
     rateVal = rate;
-    lFilter->setSampleRate(rateVal);
-    rFilter->setSampleRate(rateVal);
-  }
-  void setCutoff(float value) {
-    cutoffVal = value;
-    lFilter->setCutoff(cutoffVal);
-    rFilter->setCutoff(cutoffVal);
-  }
-  void setResonance(float value) {
-    resonanceVal = value;
-    lFilter->setResonance(resonanceVal);
-    rFilter->setResonance(resonanceVal);
+    svf.setSampleRate(rateVal);
   }
+  void setCutoff(float value) { cutoffVal = value; }
+  void setResonance(float value) { resonanceVal = value; }
+  //! block rate resonance offset from the mod matrix
+  void setResonanceMod(float offset) { resonanceMod = offset; }
   void setDepth(float value) { envDepth = value; }
   void setWetLevel(float value) { wetLevel = value; }
+  //! clears the filter state for a new note
+  void reset() { svf.reset(); }
   void tick() {
     auto modVal = env.process(envDepth);
-    auto inc = (CUTOFF_MAX - cutoffVal) * modVal;
-    lFilter->setCutoff(cutoffVal + inc);
-    rFilter->setCutoff(cutoffVal + inc);
-  }
-  void handleAsyncUpdate() override;
-  void setType(int filterType);
-  float processLeft(float input) {
-    if (currentType == None)
-      return input;
-    return MathUtil::fLerp(input, lFilter->process(input), wetLevel);
-  }
-  float processLeft(float input, float modValue) {
-    if (currentType == None)
-      return input;
-    return MathUtil::fLerp(input, lFilter->processWithMod(input, modValue),
-                           wetLevel);
-  }
-  float processRight(float input) {
-    if (currentType == None)
-      return input;
-    return MathUtil::fLerp(input, rFilter->process(input), wetLevel);
-  }
-  float processRight(float input, float modValue) {
-    if (currentType == None)
-      return input;
-    return MathUtil::fLerp(input, rFilter->processWithMod(input, modValue),
-                           wetLevel);
-  }
+    envCutoff = cutoffVal + ((CUTOFF_MAX - cutoffVal) * modVal);
+  }
+  //! block renderer equivalent of calling tick() and then processSample()
+  //! once per sample. envLevels holds this voice's filter envelope output for
+  //! the block and lfoMod is the cutoff modulation per sample (or nullptr if
+  //! nothing modulates the cutoff). The cutoff gets worked out every
+  //! StereoSVF::controlInterval samples and ramped in between
+  void processBlock(float* left,
+                    float* right,
+                    const float* envLevels,
+                    const float* lfoMod,
+                    int numSamples);
+  //! processBlock for up to maxGroupSize voices at once, filling the SIMD
+  //! lanes with a left/right pair per voice. Each argument is indexed by
+  //! filter
+  static constexpr int maxGroupSize = SVFLanes::width / 2;
+  static void processGroup(StereoFilter* const* filters,
+                           float* const* left,
+                           float* const* right,
+                           const float* const* envLevels,
+                           const float* const* lfoMod,
+                           int numFilters,
+                           int numSamples);
+  //! safe from any thread, the new type takes over at the next beginBlock()
+  void setType(int filterType) {
+    requestedType.store(filterType, std::memory_order_relaxed);
+  }
+  //! switches to the type last passed to setType(), call at a block boundary
+  //! on the rendering thread. All the types are taps of the same SVF so
+  //! there's nothing to allocate
+  void beginBlock();
+  //! the type is None or the wet level is 0, so the signal passes straight
+  //! through. Decided at beginBlock()
+  bool isBypassed() const { return bypassed; }
+  //! filters one sample of each channel at the cutoff from the last tick(),
+  //! pushed up towards CUTOFF_MAX by a positive modValue and down towards
+  //! CUTOFF_MIN by a negative one. Only mod matrix routes go negative, the
+  //! filter LFO gets clamped at 0 like it always was
+  void processSample(float& left, float& right, float modValue = 0.0f);
   VoiceEnvelope env;
   float getCutoff() const { return cutoffVal; }
 
 private:
+  //! the envelope and LFO modulated cutoff for one sample
+  float cutoffFor(float envLevel, float modValue) const {
+    return applyMod(
+        cutoffVal + ((CUTOFF_MAX - cutoffVal) * envDepth * envLevel),
+        modValue);
+  }
+  static float applyMod(float cutoff, float modValue) {
+    if (modValue > 0.0f)
+      return cutoff + ((CUTOFF_MAX - cutoff) * std::min(modValue, 1.0f));
+    return cutoff + ((cutoff - CUTOFF_MIN) * std::max(modValue, -1.0f));
+  }
+  float modulatedResonance() const {
+    return std::clamp(resonanceVal + resonanceMod, RESONANCE_MIN,
+                      RESONANCE_MAX);
+  }
   float cutoffVal;
+  float envCutoff;
   float resonanceVal;
+  float resonanceMod;
   double rateVal;
   float envDepth;
   float wetLevel;
   const int voiceIndex;
+  std::atomic<int> requestedType;
   FilterType currentType;
-  std::unique_ptr<FilterCore> lFilter;
-  std::unique_ptr<FilterCore> rFilter;
+  bool bypassed;
+  StereoSVF svf;
 };
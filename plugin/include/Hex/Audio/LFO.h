@@ -21,11 +21,15 @@ typedef std::array<float, TABLESIZE> LfoArray;
 class WaveArray {
 public:
   static LfoArray arrayForType(WaveType type);
+  //! one copy of each table for the whole process, shared by every LFO.
+  //! Built the first time this gets called
+  static const LfoArray& sharedArray(WaveType type);
 };
 //==============================================================
 class WaveLfo {
 public:
-  WaveLfo(WaveType type) : data(WaveArray::arrayForType(type)), phase(0.0f) {}
+  WaveLfo(WaveType type)
+      : data(WaveArray::sharedArray(type).data()), phase(0.0f) {}
   float tick() {
     phaseDelta = rate / (float)sampleRate;
     phase += phaseDelta;
@@ -34,16 +38,17 @@ public:
     lowerIdx = (int)std::floor(phase * (float)TABLESIZE);
     upperIdx = (lowerIdx == TABLESIZE - 1) ? 0 : lowerIdx + 1;
     skew = (phase * (float)TABLESIZE) - (float)lowerIdx;
-    return MathUtil::fLerp(data[(size_t)lowerIdx], data[(size_t)upperIdx],
-                           skew);
+    return MathUtil::fLerp(data[lowerIdx], data[upperIdx], skew);
   }
   void setRate(float speedHz) { rate = speedHz; }
   void setSampleRate(double sr) { sampleRate = sr; }
+  float getPhase() const { return phase; }
+  void setPhase(float value) { phase = value; }
 
 private:
-  float rate;
-  double sampleRate;
-  LfoArray data;
+  float rate = RATE_DEFAULT;
+  double sampleRate = 44100.0;
+  const float* data;
   float phase;
   float phaseDelta;
   int lowerIdx;
@@ -67,15 +72,15 @@ public:
   void setSampleRate(double sr) { sampleRate = sr; }
 
 private:
-  float rate;
-  double sampleRate;
+  float rate = RATE_DEFAULT;
+  double sampleRate = 44100.0;
   float phase;
   float phaseDelta;
   juce::Random rGen;
   float output;
 };
 
-class HexLfo : public juce::AsyncUpdater {
+class HexLfo {
 public:
   HexLfo(int idx);
   const int lfoIndex;
@@ -83,13 +88,40 @@ public:
   float tickToValue(float baseValue, float maxValue, float depth);
   void setSampleRate(double rate);
   void setRate(float rate);
-  void setType(int type);
-  void handleAsyncUpdate() override;
+  //! safe from any thread, the new shape takes over at the next beginBlock()
+  void setType(int type) {
+    requestedType.store(type, std::memory_order_relaxed);
+  }
+  //! switches to the shape last passed to setType(), call at a block
+  //! boundary on the rendering thread
+  void beginBlock();
 
 private:
+  std::atomic<int> requestedType;
   WaveType currentType;
-  std::unique_ptr<WaveLfo> waveOsc;
+  //! one engine per shape, all built up front so switching never allocates
+  std::array<WaveLfo, 4> waveOscs;
   NoiseLfo noiseOsc;
-  double sampleRate;
-  float currentRate = 0.0f;
+};
+
+// LFOs in global mode run once per block here instead of once in every
+// voice, and all the voices read the same values. The voices' own copies of
+// those LFOs just sit idle
+class GlobalLfoBank {
+public:
+  GlobalLfoBank();
+  void prepare(double sampleRate, int maxBlockSize);
+  HexLfo& getLfo(int idx) { return *lfos[idx]; }
+  //! fills in the values for one LFO from startSample to
+  //! startSample + numSamples
+  void render(int lfoIdx, int startSample, int numSamples);
+  //! one LFO's values, indexed by the same sample positions as the synth's
+  //! output buffer
+  const float* getValues(int lfoIdx) const {
+    return buffer.getReadPointer(lfoIdx);
+  }
+
+private:
+  juce::OwnedArray<HexLfo> lfos;
+  juce::AudioBuffer<float> buffer;
 };
@@ -0,0 +1,74 @@
+#pragma once
+#include "FMOperator.h"
+#define NUM_MOD_SLOTS 8
+
+// The general modulation matrix. Each slot connects one source to one
+// destination with a depth, the slots get compiled into a flat list of
+// routes whenever they change so the voices only ever look at the routes
+// that do something
+namespace ModSource {
+constexpr int none = 0;
+constexpr int lfo(int idx) {
+  return 1 + idx;
+}
+constexpr int opEnv(int opIdx) {
+  return 1 + NUM_LFOS + opIdx;
+}
+constexpr int filterEnv = opEnv(NUM_OPERATORS);
+constexpr int velocity = filterEnv + 1;
+constexpr int modWheel = velocity + 1;
+constexpr int numSources = modWheel + 1;
+//! names in source order, for the choice parameters
+juce::StringArray getNames();
+}  // namespace ModSource
+
+namespace ModDest {
+enum OpParam { opRatio, opModIndex, opLevel, opPan, numOpParams };
+constexpr int none = 0;
+constexpr int op(int opIdx, int param) {
+  return 1 + (opIdx * numOpParams) + param;
+}
+//! which operator and OpParam an operator destination refers to
+constexpr int opIndex(int dest) {
+  return (dest - 1) / numOpParams;
+}
+constexpr int opParam(int dest) {
+  return (dest - 1) % numOpParams;
+}
+constexpr int filterCutoff = op(NUM_OPERATORS, 0);
+constexpr int filterResonance = filterCutoff + 1;
+constexpr int numDests = filterResonance + 1;
+//! true for destinations that are read once per sub-block rather than
+//! every sample
+bool isBlockRate(int dest);
+juce::StringArray getNames();
+}  // namespace ModDest
+
+struct ModRoute {
+  int source = ModSource::none;
+  int dest = ModDest::none;
+  //! the slot's depth already scaled to the destination's units
+  float depth = 0.0f;
+};
+
+// What the voices actually read. Routes are grouped by destination so each
+// destination buffer gets cleared once and then summed into
+struct ModRouteList {
+  struct Slot {
+    int source = ModSource::none;
+    int dest = ModDest::none;
+    float depth = 0.0f;
+  };
+  using Slots = std::array<Slot, NUM_MOD_SLOTS>;
+  //! drops the slots with no source, no destination or no depth
+  static ModRouteList compile(const Slots& slots);
+  bool usesSource(int source) const;
+
+  std::array<ModRoute, NUM_MOD_SLOTS> routes;
+  int numRoutes = 0;
+  //! each distinct destination, its routes are
+  //! routes[destStart[d]] to routes[destStart[d + 1] - 1]
+  std::array<int, NUM_MOD_SLOTS> dests;
+  std::array<int, NUM_MOD_SLOTS + 1> destStart = {};
+  int numDests = 0;
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include "FMOperator.h"
+
+// The routing grid compiled into the order the operators get evaluated in and
+// the list of edges that actually exist. Operators are evaluated
+// modulators-first (a topological sort of the grid), so a carrier always sees
+// its modulators' output from the same sample. Edges that close a cycle
+// (including an operator modulating itself) can't work that way and are
+// marked as feedback edges, which read the source's output from the previous
+// sample. Compiled once whenever the grid changes and shared by every voice.
+struct ModulationSchedule {
+  struct Edge {
+    int src;
+    int dst;
+    // true if this edge reads the previous sample's output
+    bool delayed;
+  };
+  //! operator indices in evaluation order
+  std::array<int, NUM_OPERATORS> order;
+  //! edges grouped by destination in evaluation order, the edges into
+  //! order[k] are edges[edgeStart[k]] up to (not including)
+  //! edges[edgeStart[k + 1]]
+  std::array<Edge, NUM_OPERATORS * NUM_OPERATORS> edges;
+  std::array<int, NUM_OPERATORS + 1> edgeStart;
+  int numEdges;
+  int numFeedbackEdges;
+
+  ModulationSchedule();
+  static ModulationSchedule compile(const RoutingGrid& grid);
+  //! bit o is set if operator o can reach the output, either because it's
+  //! audible or because it modulates (directly or not) one that is
+  uint32_t liveOperators(uint32_t audibleMask) const;
+};
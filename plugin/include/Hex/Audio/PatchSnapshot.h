@@ -0,0 +1,67 @@
+#pragma once
+#include "FMOperator.h"
+#include "Filter.h"
+#include "LFO.h"
+#include "ModMatrix.h"
+
+// Every per-voice parameter that isn't an envelope or the routing, as one
+// plain struct. The synth fills this in between blocks and every voice reads
+// the same one by pointer, so nothing has to loop over the voices under the
+// lock when a parameter moves. The version gets bumped each time anything in
+// here changes, a voice only re-applies the snapshot to its operators, LFOs
+// and filter when the version differs from the last one it saw
+struct PatchSnapshot {
+  struct Operator {
+    float ratio = RATIO_DEFAULT;
+    float modIndex = MODINDEX_DEFAULT;
+    float pan = PAN_DEFAULT;
+    float level = 1.0f;
+    bool audible = true;
+    int wave = (int)Sine;
+  };
+  struct Lfo {
+    float rate = RATE_DEFAULT;
+    float depth = 0.0f;
+    int wave = (int)Sine;
+    //! 0 for no target, 1 - NUM_OPERATORS for an operator's level and
+    //! NUM_OPERATORS + 1 for the filter cutoff
+    int target = 0;
+    //! runs once on the synth rather than in each voice
+    bool global = false;
+  };
+  struct Filter {
+    float cutoff = CUTOFF_DEFAULT;
+    float resonance = RESONANCE_DEFAULT;
+    float wetDry = 1.0f;
+    float depth = 0.5f;
+    int type = (int)LoPass;
+  };
+  //! 0 means nothing has been published yet
+  uint64_t version = 0;
+  std::array<Operator, NUM_OPERATORS> ops;
+  std::array<Lfo, NUM_LFOS> lfos;
+  Filter filter;
+  //! the mod matrix slots, compiled
+  ModRouteList modRoutes;
+  //! the operators that can reach the output, see
+  //! ModulationSchedule::liveOperators
+  uint32_t liveOps = (1u << NUM_OPERATORS) - 1;
+
+  uint32_t audibleOps() const {
+    uint32_t mask = 0;
+    for (int o = 0; o < NUM_OPERATORS; ++o) {
+      if (ops[(size_t)o].audible)
+        mask |= 1u << o;
+    }
+    return mask;
+  }
+
+  //! the LFO that modulates the given target, or -1 if there isn't one
+  int lfoForTarget(int target) const {
+    for (int i = 0; i < NUM_LFOS; ++i) {
+      if (lfos[(size_t)i].target == target)
+        return i;
+    }
+    return -1;
+  }
+};
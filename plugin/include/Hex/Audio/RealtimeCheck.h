@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#ifndef HEX_RT_CHECK
+#define HEX_RT_CHECK 0
+#endif
+
+// Debug check for the audio thread, built in with HEX_RT_CHECK=1 (the CMake
+// option of the same name, Debug builds only). Code inside a
+// ScopedAudioThread that allocates, frees, locks a mutex or sleeps gets
+// reported on stderr with a stack trace, once per call site. The plugin only
+// marks the scopes, the interposers that catch the calls get linked into the
+// bench tools alone (bench/source/RealtimeInterpose.cpp), so no plugin or
+// standalone binary ever replaces the host's malloc. With the flag off the
+// scopes are empty and compile away
+namespace RealtimeCheck {
+constexpr bool enabled = HEX_RT_CHECK != 0;
+
+//! off is the default for every thread. Violations in known code get
+//! reported the same way but counted apart from the rest
+enum class Mode { off, checked, known };
+
+//! sets the calling thread's mode, returns the old one
+Mode setMode(Mode newMode);
+//! how many violations have been seen since the last reset, including the
+//! ones that didn't get printed because their call site already was
+uint32_t getNumViolations();
+//! the same for violations inside a ScopedKnownViolations
+uint32_t getNumKnownViolations();
+//! resets both counts
+void resetViolations();
+
+//! for the interposers: true on a thread that isn't off and isn't already
+//! in the middle of writing a report. Safe to call from inside malloc
+bool shouldReport();
+void reportViolation(const char* what);
+
+//! sets the calling thread's mode for its lifetime and puts the old one
+//! back after, so the kinds nest either way round
+template <Mode mode>
+class ScopedMode {
+public:
+#if HEX_RT_CHECK
+  ScopedMode() : previous(setMode(mode)) {}
+  ~ScopedMode() { setMode(previous); }
+#else
+  ScopedMode() {}
+#endif
+  ScopedMode(const ScopedMode&) = delete;
+  ScopedMode& operator=(const ScopedMode&) = delete;
+
+private:
+#if HEX_RT_CHECK
+  const Mode previous;
+#endif
+};
+//! marks code that renders audio
+using ScopedAudioThread = ScopedMode<Mode::checked>;
+//! for calls into JUCE that lock by design (the Synthesiser's and the
+//! keyboard state's). Those locks still get reported, as known violations,
+//! and the parts of Hex they call back into open their own ScopedAudioThread
+using ScopedKnownViolations = ScopedMode<Mode::known>;
+}  // namespace RealtimeCheck
@@ -0,0 +1,93 @@
+#pragma once
+#include <JuceHeader.h>
+// The TPT state variable filter with one independent filter per SIMD lane.
+// StereoFilter puts each voice's left and right channels in neighbouring
+// lanes, so one pass runs a whole voice (or two, four wide) at once. Which
+// output gets tapped is a template parameter, so there's no dispatch inside
+// the sample loop
+namespace SVFLanes {
+#if JUCE_USE_SIMD
+using Vec = juce::dsp::SIMDRegister<float>;
+constexpr int width = (int)Vec::SIMDNumElements;
+constexpr size_t alignment = Vec::SIMDRegisterSize;
+#else
+// plain fallback for targets JUCE has no SIMD support for
+struct Vec {
+  float v[4];
+  static Vec fromRawArray(const float* p) {
+    return {{p[0], p[1], p[2], p[3]}};
+  }
+  void copyToRawArray(float* p) const { std::copy_n(v, 4, p); }
+  Vec operator+(Vec b) const {
+    return {{v[0] + b.v[0], v[1] + b.v[1], v[2] + b.v[2], v[3] + b.v[3]}};
+  }
+  Vec operator-(Vec b) const {
+    return {{v[0] - b.v[0], v[1] - b.v[1], v[2] - b.v[2], v[3] - b.v[3]}};
+  }
+  Vec operator*(Vec b) const {
+    return {{v[0] * b.v[0], v[1] * b.v[1], v[2] * b.v[2], v[3] * b.v[3]}};
+  }
+};
+constexpr int width = 4;
+constexpr size_t alignment = 16;
+#endif
+//! the longest stretch one call can process, the coefficients ramp linearly
+//! across it
+constexpr int maxSegment = 16;
+
+enum Output { lowpass, highpass, bandpass };
+
+//! everything is indexed by lane, samples are interleaved so each one is a
+//! single aligned load
+struct Data {
+  alignas(alignment) float s1[width];
+  alignas(alignment) float s2[width];
+  alignas(alignment) float g[width];
+  alignas(alignment) float r2[width];
+  alignas(alignment) float h[width];
+  //! per sample coefficient increments
+  alignas(alignment) float dg[width];
+  alignas(alignment) float dr2[width];
+  alignas(alignment) float dh[width];
+  alignas(alignment) float wet[width];
+  //! input in, filtered and wet/dry mixed output out
+  alignas(alignment) float x[maxSegment][width];
+};
+
+//! filters numSamples (up to maxSegment) samples of every lane in place and
+//! writes the integrator state back. The coefficients in d are left where
+//! they started, the caller snaps them to their targets afterwards
+template <Output output>
+void process(Data& d, int numSamples) {
+  Vec s1 = Vec::fromRawArray(d.s1);
+  Vec s2 = Vec::fromRawArray(d.s2);
+  Vec g = Vec::fromRawArray(d.g);
+  Vec r2 = Vec::fromRawArray(d.r2);
+  Vec h = Vec::fromRawArray(d.h);
+  const Vec dg = Vec::fromRawArray(d.dg);
+  const Vec dr2 = Vec::fromRawArray(d.dr2);
+  const Vec dh = Vec::fromRawArray(d.dh);
+  const Vec wet = Vec::fromRawArray(d.wet);
+  for (int i = 0; i < numSamples; ++i) {
+    g = g + dg;
+    r2 = r2 + dr2;
+    h = h + dh;
+    const Vec x = Vec::fromRawArray(d.x[i]);
+    const Vec hp = h * (x - (s1 * (g + r2)) - s2);
+    const Vec gHp = g * hp;
+    const Vec bp = gHp + s1;
+    s1 = gHp + bp;
+    const Vec gBp = g * bp;
+    const Vec lp = gBp + s2;
+    s2 = gBp + lp;
+    Vec y = lp;
+    if constexpr (output == highpass)
+      y = hp;
+    else if constexpr (output == bandpass)
+      y = bp;
+    (x + ((y - x) * wet)).copyToRawArray(d.x[i]);
+  }
+  s1.copyToRawArray(d.s1);
+  s2.copyToRawArray(d.s2);
+}
+}  // namespace SVFLanes
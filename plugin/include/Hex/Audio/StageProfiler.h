@@ -0,0 +1,62 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#ifndef HEX_PROFILE_STAGES
+#define HEX_PROFILE_STAGES 0
+#endif
+
+// Opt-in timing for the stages of the render loop, built in with
+// HEX_PROFILE_STAGES=1 (the CMake option of the same name). Each pass through
+// a stage lands in a log2 histogram for that stage and voice, kept in relaxed
+// atomics so the audio thread and the render workers never wait on each
+// other. With the flag off the timers are empty and compile away
+namespace StageProfiler {
+enum Stage {
+  envelopes,
+  modulation,
+  oscillators,
+  output,
+  filter,
+  scalarVoice,
+  scopeTap,
+  globalLfos,
+  paramUpdate,
+  updateRouting,
+  updateOscillators,
+  updateEnvelopes,
+  updateFilters,
+  updateLfos,
+  updateModMatrix,
+  numStages
+};
+//! the voice index for work that doesn't belong to one voice, i.e. the
+//! synth's own stages and the voice bank's groups
+constexpr int shared = -1;
+constexpr bool enabled = HEX_PROFILE_STAGES != 0;
+
+void record(Stage stage, int voice, juce::int64 ticks);
+void reset();
+//! every stage's count, total, mean and max time, its histogram and its
+//! totals per voice, in microseconds
+juce::var toVar();
+bool writeReport(const juce::File& file);
+
+class ScopedTimer {
+public:
+#if HEX_PROFILE_STAGES
+  ScopedTimer(Stage s, int voiceIdx)
+      : stage(s),
+        voice(voiceIdx),
+        start(juce::Time::getHighResolutionTicks()) {}
+  ~ScopedTimer() {
+    record(stage, voice, juce::Time::getHighResolutionTicks() - start);
+  }
+
+private:
+  const Stage stage;
+  const int voice;
+  const juce::int64 start;
+#else
+  ScopedTimer(Stage, int) {}
+#endif
+};
+}  // namespace StageProfiler
@@ -14,7 +14,13 @@
 #include "FMOperator.h"
 #include "Filter.h"
 #include "LFO.h"
+#include "ModulationSchedule.h"
+#include "ParamRegistry.h"
+#include "PatchSnapshot.h"
 #include "RingBuffer.h"
+#include "VoiceAllocator.h"
+#include "VoiceBank.h"
+#include "VoiceRenderPool.h"
 #include "juce_audio_basics/juce_audio_basics.h"
 #include "juce_core/juce_core.h"
 typedef std::array<std::array<float, NUM_OPERATORS>, NUM_VOICES> fVoiceOp;
@@ -57,7 +63,10 @@ public:
            GraphParamSet* gParams,
            RingBuffer<float>* buffer,
            int idx,
-           EnvelopeLUTGroup* envLuts);
+           EnvelopeLUTGroup* envLuts,
+           const ModulationSchedule* sched,
+           const PatchSnapshot* patchSnapshot,
+           const GlobalLfoBank* globalLfoBank);
   apvts* const linkedTree;
   GraphParamSet* const linkedParams;
   RingBuffer<float>* const linkedBuffer;
@@ -81,12 +90,28 @@ public:
                  int currentPitchWheelPosition) override;
   void nStartNote(int midiNoteNumber, float velocity, int pitchWheelPos);
   void stopNote(float velocity, bool allowTailOff) override;
+  //! makes the next startNote() wait for the current note to fade out
+  //! through killQuick() before it triggers anything. It's a fade out and
+  //! then a fresh start rather than a crossfade, a voice only holds one note
+  void prepareToSteal() { stealPending = true; }
+  //! starts a note held back by prepareToSteal() once the old one's
+  //! operators are silent. Called before and after each sub-block (or block,
+  //! on the per-sample path) and before a finished voice gets cleared
+  void startPendingNote();
+  bool hasPendingNote() const { return pendingNote != -1; }
+  float getPendingVelocity() const { return pendingVelocity; }
+  //! the loudest of the audible operators' envelopes right now
+  float getCurrentLevel() const;
   //=============================================
-  void updateGrid(RoutingGrid& newGrid) { grid = newGrid; }
+  //! the schedule is owned by the synth and only changes between blocks
+  const ModulationSchedule* getSchedule() const { return schedule; }
   //=============================================
   void pitchWheelMoved(int) override {}
   //=============================================
   void controllerMoved(int, int) override {}
+  //! the synth passes the mod wheel to every voice, not just the ones
+  //! playing, so new notes start with the current value
+  void setModWheel(float value) { modWheel = value; }
   //===============================================
   void aftertouchChanged(int) override {}
   //==============================================
@@ -95,23 +120,80 @@ public:
   void renderNextBlock(juce::AudioBuffer<float>& outputBuffer,
                        int startSample,
                        int numSamples) override;
+  //! switch between the stage-by-stage block renderer and the original
+  //! per-sample path (kept around as a reference to compare against)
+  void setBlockRendering(bool shouldUseBlocks) {
+    useBlockRendering = shouldUseBlocks;
+  }
+  bool isBlockRendering() const { return useBlockRendering; }
+  //! contiguous per-stage scratch space for the block renderer
+  struct BlockBuffers {
+    alignas(32) float opGain[NUM_OPERATORS][VOICE_SUB_BLOCK];
+    alignas(32) float opEnv[NUM_OPERATORS][VOICE_SUB_BLOCK];
+    alignas(32) float opOut[NUM_OPERATORS][VOICE_SUB_BLOCK];
+    alignas(32) float filterEnv[VOICE_SUB_BLOCK];
+    //! each LFO's raw output, only filled for LFOs that have a target or
+    //! feed the mod matrix
+    alignas(32) float lfo[NUM_LFOS][VOICE_SUB_BLOCK];
+    //! the filter LFO and any mod matrix cutoff routes, summed
+    alignas(32) float cutoffMod[VOICE_SUB_BLOCK];
+    //! one per destination in the patch's ModRouteList
+    alignas(32) float modDest[NUM_MOD_SLOTS][VOICE_SUB_BLOCK];
+    alignas(32) float left[VOICE_SUB_BLOCK];
+    alignas(32) float right[VOICE_SUB_BLOCK];
+  };
+  //! the block renderer's stages, public so that the VoiceBank can run the
+  //! operator stage for several voices at once. A block goes
+  //! beginBlock -> (envelope, modulation, operator, output stages for
+  //! each sub-block) -> finishBlock. The envelopes go first because the mod
+  //! matrix can read them
+  void beginBlock(juce::AudioBuffer<float>& outputBuffer);
+  void renderModulationStage(int startSample, int numSamples);
+  void renderEnvelopeStage(int numSamples);
+  void renderOperatorStage(int numSamples);
+  void renderOutputStage(int startSample, int numSamples);
+  //! the output stage is the pan stage, voiceFilter.processBlock and then
+  //! writeOutputStage, split up so the VoiceBank can filter voices together
+  void renderPanStage(int numSamples);
+  void writeOutputStage(int startSample, int numSamples);
+  //! this sub-block's cutoff modulation for the filter, or nullptr if
+  //! nothing modulates it
+  const float* getFilterMod() const {
+    return cutoffModActive ? blockBufs.cutoffMod : nullptr;
+  }
+  void finishBlock(juce::AudioBuffer<float>& outputBuffer,
+                   int startSample,
+                   int numSamples);
+  //! beginBlock plus whichever render path is active. Only touches this
+  //! voice's own state, so different voices can do this on different threads
+  void renderToInternalBuffer(juce::AudioBuffer<float>& outputBuffer,
+                              int startSample,
+                              int numSamples);
+  BlockBuffers& getBlockBuffers() { return blockBufs; }
+  //! bit o is set if operator o is live in the patch and its envelope is
+  //! making sound this sub-block, worked out by the envelope stage
+  uint32_t getActiveOps() const { return activeOps; }
+  double getFundamental() const { return fundamental; }
   juce::OwnedArray<FMOperator> operators;
   juce::OwnedArray<HexLfo> lfos;
   StereoFilter voiceFilter;
-  //! function to make sure each operator has the appropriate offset before
-  //! calculating samples
-  void tickModulation();
+  //! sets the operator's mod offset from its modulators, following the
+  //! schedule. Must be called in schedule order
+  void applyModulation(int scheduleIdx) {
+    auto* op = operators[schedule->order[(size_t)scheduleIdx]];
+    op->clearOffset();
+    for (int e = schedule->edgeStart[(size_t)scheduleIdx];
+         e < schedule->edgeStart[(size_t)scheduleIdx + 1]; ++e) {
+      op->addModFrom(*operators[schedule->edges[(size_t)e].src]);
+    }
+  }
 
   //===============================================
-  void setRatio(int idx, float value) { operators[idx]->setRatio(value); }
-  void setModIndex(int idx, float value) { operators[idx]->setModIndex(value); }
-  void setPan(int idx, float value) { operators[idx]->setPan(value); }
-  void setAudible(int idx, bool value) { operators[idx]->setAudible(value); }
-  void setLevel(int idx, float value) { operators[idx]->setLevel(value); }
-  void setWave(int idx, float value) { operators[idx]->setWave((int)value); }
-  bool anyEnvsActive() {
-    for (auto op : operators) {
-      if (op->vEnv.isActive())
+  //! true while any operator that can reach the output is still sounding,
+  //! operators that can't don't keep the voice going
+  bool anyEnvsActive() const {
+    for (int o = 0; o < NUM_OPERATORS; ++o) {
+      if (((patch->liveOps >> o) & 1) && !operators[o]->vEnv.isSilent())
         return true;
     }
     return false;
@@ -123,33 +205,74 @@ public:
     voiceFilter.env.killQuick();
   }
   bool isVoiceCleared() { return voiceCleared; }
-  float filterMod() {
-    for (int i = 0; i < NUM_LFOS; ++i) {
-      if (lfoTargets[i] == NUM_OPERATORS + 1)
-        return lfos[i]->tick() * lfoDepths[i];
-    }
-    return 0.0f;
+  //! per-sample counterparts of the modulation stage for the reference
+  //! path: tickLfos() advances each LFO in use once, and the others read
+  //! the values it left
+  void tickLfos(int sample);
+  //! folds this sample's LFO levels and mod matrix routes into the first
+  //! sample of the block buffers' gains and cutoff modulation, the same way
+  //! renderModulationStage does for a whole sub-block
+  void tickModulation();
+  //! like the block path, the LFO only ever pushes the cutoff up
+  float filterMod() const {
+    return (filterLfoIdx != -1) ? std::max(lfoSample[filterLfoIdx], 0.0f)
+                                : 0.0f;
   }
-  float levelMod(int opIdx) {
-    for (int i = 0; i < NUM_LFOS; ++i) {
-      if (lfoTargets[i] == opIdx + 1)
-        return lfos[i]->tick() * lfoDepths[i];
-    }
-    return 0.0f;
+  float levelMod(int opIdx) const {
+    const int idx = opLfoIdx[opIdx];
+    return (idx != -1) ? lfoSample[idx] : 0.0f;
   }
   bool justKilled;
-  int lfoTargets[NUM_LFOS];
-  float lfoDepths[NUM_LFOS];
-  float lfoValues[NUM_LFOS];
 
 private:
+  //! the two render paths, both write into internalBuffer
+  void renderScalar(int startSample, int numSamples);
+  void renderBlock(int startSample, int numSamples);
+  void renderSubBlock(int startSample, int numSamples);
+  void triggerNote(int midiNoteNumber, float velocity);
+  //! pushes the shared patch into the operators, LFOs and filter if it's
+  //! changed since this voice last looked at it
+  void applyPatch();
+  //! works out which LFO (if any) drives each target, done once whenever
+  //! the patch changes rather than searched for every sample
+  void resolveLfoTargets();
+  //! sums the patch's mod routes into their destinations for a sub-block,
+  //! only called when there are any
+  void renderModMatrix(int numSamples);
+  void applyModDest(int dest, const float* values, int numSamples);
+  //! a source's sub-block buffer, or nullptr for the ones that are
+  //! constant through a note (see modSourceValue)
+  const float* modSourceBuffer(int source) const;
+  float modSourceValue(int source) const {
+    return (source == ModSource::velocity) ? noteVelocity : modWheel;
+  }
+  //! any source's current value for the per-sample path
+  float modSourceSample(int source) const;
+  BlockBuffers blockBufs;
+  uint32_t activeOps;
+  int opLfoIdx[NUM_OPERATORS];
+  int filterLfoIdx;
+  bool lfoInUse[NUM_LFOS];
+  float lfoSample[NUM_LFOS];
+  //! lfoSample without the LFO's depth, what the mod matrix reads
+  float lfoValue[NUM_LFOS];
+  bool cutoffModActive;
+  float noteVelocity;
+  float modWheel;
+  bool useBlockRendering;
   AsyncDebugPrinter debugPrinter;
   juce::AudioBuffer<float> internalBuffer;
   float sumL;
   float sumR;
   double fundamental;
-  RoutingGrid grid;
+  const ModulationSchedule* const schedule;
+  const PatchSnapshot* const patch;
+  uint64_t appliedPatchVersion;
+  const GlobalLfoBank* const globalLfos;
   bool voiceCleared;
+  bool stealPending;
+  int pendingNote;
+  float pendingVelocity;
   float magnitude;
   float lastMagnitude;
   float filterValue;
@@ -157,54 +280,72 @@ private:
 
 class HexSynth : public juce::Synthesiser {
 public:
-  HexSynth(apvts* tree);
+  HexSynth(apvts* tree, const ParamRegistry* registry);
   ~HexSynth() override {}
   apvts* const linkedTree;
+  const ParamRegistry* const paramRegistry;
   void setSampleRate(double newRate, int blockSize = 512) {
     setCurrentPlaybackSampleRate(newRate);
+    lastBlockSize = blockSize;
+    voiceBank.setSampleRate(newRate);
+    globalLfos.prepare(newRate, blockSize);
     for (auto voice : hexVoices) {
       voice->setSampleRate(newRate, blockSize);
     }
   }
-  // juce::SynthesiserVoice* findFreeVoice(
-  //     juce::SynthesiserSound* soundToPlay,
-  //     int midiChannel,
-  //     int midiNoteNum,
-  //     bool stealIfNoneAvailible) const override;
-  // void noteOn(int midiChannel, int midiNoteNumber, float velocity) override;
-  // void noteOff(int midiChannel,
-  //              int midiNoteNumber,
-  //              float velocity,
-  //              bool allowTailOff) override;
+  //! voices come off the allocator's free list, when there are none left
+  //! the quietest voice gets faded out and reused
+  void noteOn(int midiChannel, int midiNoteNumber, float velocity) override;
+  void noteOff(int midiChannel,
+               int midiNoteNumber,
+               float velocity,
+               bool allowTailOff) override;
   void renderVoices(juce::AudioBuffer<float>& buffer,
                     int startSample,
                     int numSamples) override;
+  //! brackets each processBlock so this synth's envelopes know when their
+  //! old segment sets can be freed, see SharedEnvData
+  void beginAudioBlock() { envelopeData.beginAudioBlock(); }
+  void endAudioBlock() { envelopeData.endAudioBlock(); }
+  //! no voice is playing or fading out. Only meaningful on the audio thread
+  bool isIdle() const { return allocator.allFree(); }
+  //! voices playing or fading out, only meaningful on the audio thread
+  int getNumActiveVoices() const { return NUM_VOICES - allocator.getNumFree(); }
+  //! how long a voice can keep sounding after its note-off, from the longest
+  //! operator or filter envelope release. Safe from any thread
+  double getTailLengthSeconds() const;
+  //! for blocks skipped while idle: keeps the global LFOs running so they
+  //! carry on in phase when the next note comes
+  void advanceIdle(int numSamples) { renderGlobalLfos(0, numSamples); }
+  void handleController(int midiChannel,
+                        int controllerNumber,
+                        int controllerValue) override;
+  //! see HexVoice::setBlockRendering
+  void setBlockRendering(bool shouldUseBlocks);
+  //! render the voices' operator stages in SIMD lanes, only applies when
+  //! block rendering is on
+  void setVoiceBankEnabled(bool shouldBeEnabled);
+  VoiceBank& getVoiceBank() { return voiceBank; }
+  //! cubic is smoother at low pitches but the voice bank only vectorises
+  //! linear, voices using cubic fall back to the per-voice operator stage
+  void setOscInterpolation(OscInterpolation mode);
+  //! spread the active voices across a pool of worker threads. Starts/stops
+  //! threads so call this from the message thread or prepareToPlay, not the
+  //! audio thread. numWorkers < 0 means one less than the number of cores
+  void setThreadedRendering(bool shouldBeThreaded, int numWorkers = -1);
+  bool isThreadedRendering() const { return renderPool != nullptr; }
 
   //===============================================
+  //! polls the parameters and runs the update functions below for
+  //! whatever changed since the last block
+  void updateParametersForBlock();
   void updateRoutingForBlock();
   void updateEnvelopesForBlock();
   void updateOscillatorsForBlock();
   void updateFiltersForBlock();
   void updateLfosForBlock();
-  //! LFO update functions
-  void setRate(int idx, float value);
-  void setDepth(int idx, float value);
-  void setLfoWave(int idx, float value);
-  void setTarget(int idx, float value);
-  //=================================================
-  //! Filter Parameters
-  void setCutoff(float value);
-  void setResonance(float value);
-  void setWetDry(float value);
-  void setDepth(float value);
-  void setFilterType(float value);
-  //===============================================
-  void setRatio(int idx, float value);
-  void setModIndex(int idx, float value);
-  void setPan(int idx, float value);
-  void setLevel(int idx, float value);
-  void setAudible(int idx, bool value);
-  void setWave(int idx, float value);
+  void updateModMatrixForBlock();
+  const PatchSnapshot& getPatch() const { return patch; }
   //===============================================
   void prepareRingBuffer(int blockSize) {
     juce::ignoreUnused(blockSize);
@@ -219,9 +360,39 @@ public:
   RingBuffer<float> graphBuffer;
 
 private:
+  ParamSnapshot paramValues;
   RoutingGrid grid;
+  ModulationSchedule schedule;
+  //! only written between blocks by updateParametersForBlock
+  PatchSnapshot patch;
+  bool patchChanged;
   EnvelopeLUTGroup envelopeData;
   std::vector<HexVoice*> hexVoices;
+  VoiceBank voiceBank;
+  bool blockRendering;
+  VoiceAllocator allocator;
+  //! whichever of the render paths below is active
+  void renderActiveVoices(juce::AudioBuffer<float>& buffer,
+                          int startSample,
+                          int numSamples);
+  //! released notes first, then the lowest envelope level, voices already
+  //! waiting on a steal only once there's nothing else
+  int findVoiceToSteal() const;
+  //! gives the voices that finished this block back to the allocator
+  void releaseFinishedVoices();
+  //! threaded rendering
+  static void renderPooledVoice(void* context, int jobIndex);
+  //! ticks the LFOs in global mode that have a target or feed the mod
+  //! matrix
+  void renderGlobalLfos(int startSample, int numSamples);
+  GlobalLfoBank globalLfos;
+  uint64_t globalLfoPatchVersion;
+  std::unique_ptr<VoiceRenderPool> renderPool;
+  HexVoice* pooledVoices[NUM_VOICES];
+  juce::AudioBuffer<float>* pooledOutput;
+  int pooledStart;
+  int pooledNumSamples;
+  int lastBlockSize;
   AsyncDebugPrinter printer;
   float magnitude;
   float lastMagnitude;
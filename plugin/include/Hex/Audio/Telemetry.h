@@ -0,0 +1,70 @@
+#pragma once
+#include <juce_core/juce_core.h>
+#include <array>
+#include <atomic>
+
+// what one audio callback cost
+struct BlockTelemetry {
+  float callbackMicros = 0.0f;
+  //! of the time the block's samples take to play
+  float budgetPercent = 0.0f;
+  int activeVoices = 0;
+};
+
+// Timing for the CPU meter. processBlock writes one BlockTelemetry per
+// callback into a single producer/single consumer ring that the editor
+// drains, and bumps lock-free counters for the blocks that came close to
+// (or went past) their deadline. Nothing gets timed unless the meter is on
+// screen, otherwise each block costs one relaxed load
+class Telemetry {
+public:
+  static constexpr int ringSize = 256;
+  //! blocks using more of their budget than this count as near xruns
+  static constexpr float nearXrunPercent = 80.0f;
+
+  void prepare(double sampleRate) { rate = sampleRate; }
+  //! the meter turns this on while it's showing. Safe from any thread
+  void setEnabled(bool shouldBeEnabled) {
+    enabled.store(shouldBeEnabled, std::memory_order_relaxed);
+  }
+  //! audio thread, call at the very start of processBlock. Returns 0 when
+  //! the meter is hidden
+  juce::int64 blockStarted() const {
+    return enabled.load(std::memory_order_relaxed)
+               ? juce::Time::getHighResolutionTicks()
+               : 0;
+  }
+  //! audio thread, call at the very end of processBlock with what
+  //! blockStarted() returned
+  void blockFinished(juce::int64 startTicks, int numSamples, int activeVoices);
+
+  //! message thread, hands each block recorded since the last call to fn
+  template <typename Fn>
+  void readBlocks(Fn&& fn) {
+    const auto scope = fifo.read(fifo.getNumReady());
+    for (int i = 0; i < scope.blockSize1; ++i)
+      fn(ring[(size_t)(scope.startIndex1 + i)]);
+    for (int i = 0; i < scope.blockSize2; ++i)
+      fn(ring[(size_t)(scope.startIndex2 + i)]);
+  }
+  uint32_t getNumNearXruns() const {
+    return nearXruns.load(std::memory_order_relaxed);
+  }
+  uint32_t getNumXruns() const {
+    return xruns.load(std::memory_order_relaxed);
+  }
+  //! blocks that didn't fit because the editor fell behind
+  uint32_t getNumDropped() const {
+    return dropped.load(std::memory_order_relaxed);
+  }
+  void resetCounters();
+
+private:
+  double rate = 44100.0;
+  std::atomic<bool> enabled{false};
+  std::atomic<uint32_t> nearXruns{0};
+  std::atomic<uint32_t> xruns{0};
+  std::atomic<uint32_t> dropped{0};
+  juce::AbstractFifo fifo{ringSize};
+  std::array<BlockTelemetry, ringSize> ring;
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include "FMOperator.h"
+
+// Keeps track of which voices are free and which voice holds each note, so
+// note-ons and note-offs never have to search the voices. Only touched on
+// the audio thread, under the synth's lock
+class VoiceAllocator {
+public:
+  VoiceAllocator();
+  //! takes a voice off the free list, or returns -1 if every voice is busy
+  int acquire();
+  //! puts a voice that's finished back on the free list and forgets its note
+  void release(int voice);
+  bool isFree(int voice) const { return onFreeList[(size_t)voice]; }
+  bool allFree() const { return numFree == NUM_VOICES; }
+  int getNumFree() const { return numFree; }
+  void mapNote(int voice, int midiChannel, int midiNoteNumber);
+  //! forgets the voice's note, if it still holds one
+  void unmapNote(int voice);
+  //! the voice holding this note, or -1
+  int voiceFor(int midiChannel, int midiNoteNumber) const {
+    return noteMap[(size_t)channelIdx(midiChannel)][(size_t)midiNoteNumber];
+  }
+
+private:
+  static int channelIdx(int midiChannel) {
+    return std::clamp(midiChannel, 1, 16) - 1;
+  }
+  //! used as a stack, the most recently freed voice goes out first
+  std::array<int, NUM_VOICES> freeList;
+  int numFree;
+  std::array<bool, NUM_VOICES> onFreeList;
+  std::array<std::array<int8_t, 128>, 16> noteMap;
+  //! where each voice sits in noteMap, -1 for none
+  std::array<int, NUM_VOICES> voiceChannel;
+  std::array<int, NUM_VOICES> voiceNote;
+};
@@ -0,0 +1,45 @@
+#pragma once
+#include "VoiceLanes.h"
+#include "FMOperator.h"
+
+class HexVoice;
+
+// Renders groups of voices with the operator stage running across voices in
+// SIMD lanes: 8 voices per instruction with AVX2, 4 with SSE2, picked at
+// runtime. Per-voice state is loaded into the structure-of-arrays lane data
+// at the start of each sub-block and handed back at the end, so the voices
+// themselves stay the source of truth and the per-voice renderer can still be
+// used for comparison. The modulation, envelope and pan stages already run
+// over contiguous per-voice buffers and stay per voice, the filter stage runs
+// through StereoFilter::processGroup a few voices at a time.
+class VoiceBank {
+public:
+  VoiceBank();
+  void setSampleRate(double rate);
+  void setEnabled(bool shouldBeEnabled) { enabled = shouldBeEnabled; }
+  bool isEnabled() const { return enabled; }
+  //! number of voices rendered per group (4 or 8)
+  int getLaneWidth() const { return laneWidth; }
+  //! force a narrower kernel, mostly for comparing the kernels against each
+  //! other. Requests wider than the CPU supports get clamped
+  void setLaneWidth(int width);
+  //! renders up to getLaneWidth() voices through the block renderer
+  void renderGroup(HexVoice** voices,
+                   int numVoices,
+                   int startSample,
+                   int numSamples);
+
+private:
+  //! copies the voices' state into the lane data, returns false if some
+  //! operator can't be vectorised (noise, or voices in different modes)
+  bool loadLanes(HexVoice** voices, int numVoices, int numSamples);
+  void storeLanes(HexVoice** voices, int numVoices, int numSamples);
+  void runKernel(int numSamples);
+  void renderFilterStage(HexVoice** voices, int numVoices, int numSamples);
+  VoiceLanes::Data data;
+  //! the operators active in any voice of the group being rendered
+  uint32_t activeOps;
+  int laneWidth;
+  int maxLaneWidth;
+  bool enabled;
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+// Plain structure-of-arrays data for the VoiceBank's vectorised operator
+// kernels. The AVX2 kernel gets compiled with its own code generation flags,
+// so this header (and the kernel sources) must not pull in JUCE or anything
+// else that defines inline functions
+namespace VoiceLanes {
+constexpr int maxLanes = 8;
+constexpr int numOperators = 6;
+constexpr int subBlockSize = 32;
+constexpr int tableSize = 2048;
+// phases are 32 bit fixed point, the top tableBits bits are the table index
+constexpr int tableBits = 11;
+constexpr int fracBits = 32 - tableBits;
+constexpr float minHz = 10.0f;
+
+enum OpMode { sineMode, waveMode };
+
+//! state for up to maxLanes voices, indexed [operator][lane] or
+//! [operator][sample][lane]
+struct Data {
+  alignas(32) uint32_t phase[numOperators][maxLanes];
+  alignas(32) float baseHz[numOperators][maxLanes];
+  // the same in double, the unmodulated phase increments get worked out
+  // from this the way PhaseAccumulator does so the lanes stay in tune with
+  // the voices
+  alignas(32) double exactHz[numOperators][maxLanes];
+  alignas(32) float modIndex[numOperators][maxLanes];
+  alignas(32) float lastOut[numOperators][maxLanes];
+  alignas(32) float gain[numOperators][subBlockSize][maxLanes];
+  alignas(32) float env[numOperators][subBlockSize][maxLanes];
+  alignas(32) float out[numOperators][subBlockSize][maxLanes];
+  // the band-limited table each lane reads in wave mode, picked for the
+  // lane's unmodulated pitch once per sub-block
+  alignas(32) const float* tables[numOperators][maxLanes];
+  OpMode modes[numOperators];
+  // the voices' ModulationSchedule: operators are evaluated in order[] and
+  // the sources modulating order[k] are edgeSrc[edgeStart[k]] up to
+  // edgeSrc[edgeStart[k + 1]]. Only the first numOrdered operators (the ones
+  // active in some lane) get evaluated at all
+  int order[numOperators];
+  int numOrdered;
+  int edgeStart[numOperators + 1];
+  int edgeSrc[numOperators * numOperators];
+  const float* sineTable;
+  float nyquist;
+  double sampleRate;
+};
+
+//! these run the operator stage for numSamples samples on the first 4
+//! (scalar and SSE2) or 8 (AVX2) lanes of the data
+void renderScalar(Data& data, int numSamples);
+void renderSSE(Data& data, int numSamples);
+void renderAVX2(Data& data, int numSamples);
+}  // namespace VoiceLanes
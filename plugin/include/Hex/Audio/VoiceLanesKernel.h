@@ -0,0 +1,106 @@
+#pragma once
+#include "VoiceLanes.h"
+// The operator kernel, written once against a small set of vector
+// operations. Each kernel source file includes this with its own Ops type;
+// everything here lives in an anonymous namespace so the differently-compiled
+// instantiations can never be merged by the linker
+namespace {
+
+//! PhaseAccumulator::setFrequency's increment, kept in double so the lanes
+//! and the per-voice oscillators agree to the bit
+inline uint32_t phaseIncrement(double hz, const VoiceLanes::Data& d) {
+  // no std::clamp, this header can't pull in inline functions
+  const double nyquist = d.sampleRate / 2.0;
+  hz = (hz < VoiceLanes::minHz) ? VoiceLanes::minHz : hz;
+  hz = (hz > nyquist) ? nyquist : hz;
+  return (uint32_t)((hz / d.sampleRate) * 4294967296.0);
+}
+
+template <class Ops>
+inline void renderLanes(VoiceLanes::Data& d, int numSamples) {
+  using namespace VoiceLanes;
+  using V = typename Ops::V;
+  using VI = typename Ops::VI;
+  constexpr int width = Ops::width;
+  // hz -> fixed point phase increment
+  const V incScale = Ops::set1((float)(4294967296.0 / d.sampleRate));
+  const VI fracMask = Ops::set1Int((int32_t)((1u << fracBits) - 1));
+  const V fracScale = Ops::set1(1.0f / (float)(1u << fracBits));
+  const VI oneInt = Ops::set1Int(1);
+  const VI tableMask = Ops::set1Int(tableSize - 1);
+
+  VI phase[numOperators];
+  V last[numOperators];
+  V modIndex[numOperators];
+  // the exact increment for each lane's unmodulated pitch. Modulation adds
+  // its own increment on top, worked out in float, so only that part can be
+  // off by a bit or so from what the per-voice oscillators do
+  VI baseIncrement[numOperators];
+  // how far the pitch can be modulated before it hits the same limits
+  // PhaseAccumulator clamps to, relative to the clamped base pitch. A base
+  // outside the limits starts out with its excess already added in
+  V baseExcess[numOperators];
+  V lowOffset[numOperators];
+  V highOffset[numOperators];
+  for (int k = 0; k < d.numOrdered; ++k) {
+    const int o = d.order[k];
+    phase[o] = Ops::loadInt(reinterpret_cast<const int32_t*>(d.phase[o]));
+    last[o] = Ops::load(d.lastOut[o]);
+    modIndex[o] = Ops::load(d.modIndex[o]);
+    alignas(32) int32_t increments[width];
+    for (int l = 0; l < width; ++l)
+      increments[l] = (int32_t)phaseIncrement(d.exactHz[o][l], d);
+    baseIncrement[o] = Ops::loadInt(increments);
+    const V baseHz = Ops::load(d.baseHz[o]);
+    const V clampedHz =
+        Ops::min(Ops::max(baseHz, Ops::set1(minHz)), Ops::set1(d.nyquist));
+    baseExcess[o] = Ops::sub(baseHz, clampedHz);
+    lowOffset[o] = Ops::sub(Ops::set1(minHz), clampedHz);
+    highOffset[o] = Ops::sub(Ops::set1(d.nyquist), clampedHz);
+  }
+
+  for (int i = 0; i < numSamples; ++i) {
+    for (int k = 0; k < d.numOrdered; ++k) {
+      // last[] holds this sample's output for operators that were already
+      // evaluated and the previous sample's for feedback sources
+      const int o = d.order[k];
+      VI increment = baseIncrement[o];
+      if (d.edgeStart[k] != d.edgeStart[k + 1]) {
+        V offset = Ops::zero();
+        for (int e = d.edgeStart[k]; e < d.edgeStart[k + 1]; ++e)
+          offset = Ops::add(offset, last[d.edgeSrc[e]]);
+        V hzOffset = Ops::add(baseExcess[o], Ops::mul(modIndex[o], offset));
+        hzOffset = Ops::min(Ops::max(hzOffset, lowOffset[o]), highOffset[o]);
+        increment = Ops::addInt(
+            increment, Ops::toIncrement(Ops::mul(hzOffset, incScale)));
+      }
+      phase[o] = Ops::addInt(phase[o], increment);
+      // linear interpolation between idx and the next point
+      const VI idx = Ops::template shiftRight<fracBits>(phase[o]);
+      const VI nextIdx = Ops::andInt(Ops::addInt(idx, oneInt), tableMask);
+      const V frac =
+          Ops::mul(Ops::toFloat(Ops::andInt(phase[o], fracMask)), fracScale);
+      V y0;
+      V y1;
+      if (d.modes[o] == sineMode) {
+        y0 = Ops::gather(d.sineTable, idx);
+        y1 = Ops::gather(d.sineTable, nextIdx);
+      } else {
+        // each lane may be reading a different band-limited table
+        y0 = Ops::gatherLanes(d.tables[o], idx);
+        y1 = Ops::gatherLanes(d.tables[o], nextIdx);
+      }
+      const V sample = Ops::add(y0, Ops::mul(Ops::sub(y1, y0), frac));
+      last[o] = Ops::mul(Ops::mul(sample, Ops::load(d.gain[o][i])),
+                         Ops::load(d.env[o][i]));
+      Ops::store(d.out[o][i], last[o]);
+    }
+  }
+
+  for (int k = 0; k < d.numOrdered; ++k) {
+    const int o = d.order[k];
+    Ops::storeInt(reinterpret_cast<int32_t*>(d.phase[o]), phase[o]);
+    Ops::store(d.lastOut[o], last[o]);
+  }
+}
+}  // namespace
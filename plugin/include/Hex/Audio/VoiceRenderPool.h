@@ -0,0 +1,56 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+
+// A fixed pool of real-time priority worker threads for rendering voices in
+// parallel. The threads get spawned up front and park on an atomic wait
+// between blocks. Dispatching work is lock-free and allocation-free: the jobs
+// get split into one contiguous range per participant (the workers plus the
+// calling audio thread), each participant works through its own range and
+// then steals from the others'. Each range lives in a single atomic word
+// tagged with the dispatch generation, so a worker that wakes up late can
+// never claim a job from a later dispatch.
+class VoiceRenderPool {
+public:
+  using JobFunc = void (*)(void* context, int jobIndex);
+  // max number of worker threads
+  static constexpr int maxWorkers = 15;
+  //! with fewer jobs than this run() renders them on the calling thread
+  static constexpr int minJobsToSplit = 2;
+  //! constructing and destroying the pool starts/stops threads, so neither
+  //! should happen on the audio thread
+  VoiceRenderPool(int numWorkers, int blockSize, double sampleRate);
+  ~VoiceRenderPool();
+  int getNumWorkers() const { return workers.size(); }
+  //! runs func for every job in [0, numJobs) across the workers and the
+  //! calling thread, returns once they've all finished
+  void run(int numJobs, JobFunc func, void* context);
+
+private:
+  class Worker : public juce::Thread {
+  public:
+    Worker(VoiceRenderPool& p, int participantIdx);
+    void run() override;
+
+  private:
+    VoiceRenderPool& pool;
+    const int participant;
+  };
+  //! claims and runs jobs until there are none left to claim
+  void work(int participant, uint32_t gen);
+  //! returns the claimed job index or -1
+  int claim(int lane, uint32_t gen);
+  struct alignas(64) Lane {
+    // [63:40] generation, [39:20] next job, [19:0] end of the range
+    std::atomic<uint64_t> state{0};
+  };
+  Lane lanes[maxWorkers + 1];
+  int numParticipants;
+  JobFunc currentFunc = nullptr;
+  void* currentContext = nullptr;
+  alignas(64) std::atomic<uint32_t> generation{0};
+  alignas(64) std::atomic<int> jobsRemaining{0};
+  //! workers parked in the atomic wait
+  alignas(64) std::atomic<int> numSleeping{0};
+  juce::OwnedArray<Worker> workers;
+};
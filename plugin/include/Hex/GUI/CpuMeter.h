@@ -0,0 +1,28 @@
+#pragma once
+#include "Audio/Telemetry.h"
+#include "HexHeader.h"
+
+// Shows how much of each block's time the audio thread is using, how many
+// voices are playing and how many blocks came close to an xrun. Only turns
+// the timing on while it's visible, click it to reset the counters
+class CpuMeter : public Component,
+                 public juce::SettableTooltipClient,
+                 public juce::Timer {
+public:
+  CpuMeter(Telemetry* t);
+  ~CpuMeter() override;
+  void timerCallback() override;
+  void visibilityChanged() override;
+  void mouseDown(const juce::MouseEvent& e) override;
+  void paint(juce::Graphics& g) override;
+
+private:
+  Telemetry* const telemetry;
+  //! smoothed over the last few refreshes so the number is readable
+  float averagePercent;
+  //! the worst block since the last refresh
+  float peakPercent;
+  int voices;
+  uint32_t nearXruns;
+  uint32_t xruns;
+};
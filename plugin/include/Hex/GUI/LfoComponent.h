@@ -14,6 +14,7 @@
  lfoWaveParam: int, range 0-4
  lfoRateParam: float, range 0.1 - 20 (in hZ)
  lfoSyncParam: bool, controls whether LFO should be in sync or hz mode
+ lfoGlobalParam: bool, one LFO shared by every voice instead of one per voice
  lfoTargetParam: int, range 0 - NUM_OPERATORS + 1
  lfoDepthParam: float, range 0 - 1
 
@@ -114,6 +115,7 @@ public:
 
 private:
   juce::TextButton bpmToggle;
+  juce::TextButton globalToggle;
   juce::ComboBox targetBox;
   DualModeSlider rateSlider;
   DualModeLabel rateLabel;
@@ -126,6 +128,7 @@ private:
   pSliderAttach rateAttach;
   pSliderAttach depthAttach;
   pButtonAttach syncAttach;
+  pButtonAttach globalAttach;
   pComboBoxAttach targetAttach;
   float bpm;
 };
@@ -1,13 +1,17 @@
 #pragma once
+#include "CpuMeter.h"
 #include "PatchBrowser.h"
 
 class UpperBar : public Component {
 private:
   const String versionString;
   PatchLoader loader;
+  CpuMeter cpuMeter;
 
 public:
-  UpperBar(HexState* s, const String& versionStr = "Version String goes here");
+  UpperBar(HexState* s,
+           Telemetry* telemetry,
+           const String& versionStr = "Version String goes here");
   void resized() override;
   void paint(juce::Graphics& g) override;
 };
@@ -2,10 +2,13 @@
 
 #include "HexHeader.h"
 #include "FileSystem.h"
+#include "ParamRegistry.h"
 
 class HexState {
 public:
   apvts mainTree;
+  //! needs to be declared after mainTree
+  ParamRegistry params;
   PatchLibrary patchLib;
   ValueTree patchTree;
   HexState(juce::AudioProcessor* proc);
@@ -38,9 +38,15 @@ DECLARE_ID(filterEnvDepth)
 DECLARE_ID(lfoRate)
 DECLARE_ID(lfoDepth)
 DECLARE_ID(lfoSync)
+DECLARE_ID(lfoGlobal)
 DECLARE_ID(lfoWave)
 DECLARE_ID(lfoTarget)
 
+// Mod matrix slots---------------
+DECLARE_ID(modSource)
+DECLARE_ID(modDest)
+DECLARE_ID(modDepth)
+
 // Oscillator/modulation------------
 DECLARE_ID(operatorRatio)
 DECLARE_ID(operatorLevel)
@@ -32,6 +32,15 @@ inline float hypot(float dX, float dY) {
 inline double midiToET(int midiNum) {
   return 440.0f * std::pow(SEMITONE_RATIO, (float)midiNum - 69);
 }
+//! [5/4] Pade approximant of tan(x). The error grows towards the pole: under
+//! 0.001% up to x = 1.3, 0.01% at 1.5 and 0.03% at the filters' 0.49 *
+//! sampleRate limit (x = 1.539, 31.811 against 31.821). Only for x < pi/2
+inline float fastTan(float x) {
+  const float x2 = x * x;
+  const float num = x * (945.0f + x2 * (-105.0f + x2));
+  const float den = 945.0f + x2 * (-420.0f + (15.0f * x2));
+  return num / den;
+}
 inline void fft(int N, float* ar, float* ai)
 /*
  in-place complex fft
@@ -0,0 +1,87 @@
+#pragma once
+#include "Audio/FMOperator.h"
+#include "Audio/ModMatrix.h"
+#include <bitset>
+
+// Flat indices for every parameter the synth reads on the audio thread
+namespace ParamIdx {
+enum Global {
+  velocityTracking,
+  filterEnvDelay,
+  filterEnvAttack,
+  filterEnvHold,
+  filterEnvDecay,
+  filterEnvSustain,
+  filterEnvRelease,
+  filterCutoff,
+  filterResonance,
+  filterWetDry,
+  filterEnvDepth,
+  filterType,
+  numGlobal
+};
+enum Lfo { lfoRate, lfoDepth, lfoWave, lfoTarget, lfoGlobal, numLfoParams };
+enum Operator {
+  opRatio,
+  opLevel,
+  opModIndex,
+  opPan,
+  opAudible,
+  opWave,
+  envDelay,
+  envAttack,
+  envHold,
+  envDecay,
+  envSustain,
+  envRelease,
+  // followed by one routing param for each destination operator
+  opRouting,
+  numOpParams = opRouting + NUM_OPERATORS
+};
+constexpr int lfo(int lfoIdx, int param) {
+  return numGlobal + (lfoIdx * numLfoParams) + param;
+}
+constexpr int op(int opIdx, int param) {
+  return numGlobal + (NUM_LFOS * numLfoParams) + (opIdx * numOpParams) + param;
+}
+constexpr int routing(int src, int dst) {
+  return op(src, opRouting + dst);
+}
+enum ModSlot { modSource, modDest, modDepth, numModSlotParams };
+constexpr int modSlot(int slot, int param) {
+  return op(NUM_OPERATORS, 0) + (slot * numModSlotParams) + param;
+}
+constexpr int numParams = modSlot(NUM_MOD_SLOTS, 0);
+}  // namespace ParamIdx
+
+// Pointers to the raw value of every parameter in ParamIdx, resolved once
+// when the HexState gets built so the audio thread never has to build an ID
+// string or look anything up by name
+class ParamRegistry {
+public:
+  ParamRegistry(apvts& tree);
+  float get(int idx) const {
+    return values[(size_t)idx]->load(std::memory_order_relaxed);
+  }
+
+private:
+  std::array<std::atomic<float>*, ParamIdx::numParams> values;
+};
+
+// The parameter values as of the last poll and which of them changed, so
+// the per-block updates only touch the voices for parameters that moved
+class ParamSnapshot {
+public:
+  ParamSnapshot();
+  //! reads every parameter, returns true if anything changed since the
+  //! last call. Everything counts as changed on the first call
+  bool poll(const ParamRegistry& registry);
+  bool isDirty(int idx) const { return dirty[(size_t)idx]; }
+  //! true if any of count params starting at first changed
+  bool anyDirty(int first, int count) const;
+  float operator[](int idx) const { return values[(size_t)idx]; }
+
+private:
+  std::array<float, ParamIdx::numParams> values;
+  std::bitset<ParamIdx::numParams> dirty;
+};
@@ -14,6 +14,7 @@
 #include "Audio/Filter.h"
 #include "GUI/LfoComponent.h"
 #include "Audio/LFO.h"
+#include "Audio/ModMatrix.h"
 #include "Identifiers.h"
 #include "juce_audio_processors/juce_audio_processors.h"
 using fRange = juce::NormalisableRange<float>;
@@ -108,6 +109,7 @@ public:
       String rateId = ID::lfoRate + iStr;
       String depthId = ID::lfoDepth + iStr;
       String syncId = ID::lfoSync + iStr;
+      String globalId = ID::lfoGlobal + iStr;
       String rateName = "LFO " + iStr + " rate";
       layout.add(std::make_unique<AudioParamFloat>(
           juce::ParameterID{rateId, 1}, rateName, rateRange, RATE_DEFAULT));
@@ -116,6 +118,8 @@ public:
           0.0f));
       layout.add(std::make_unique<AudioParamBool>(
           juce::ParameterID{syncId, 1}, "LFO " + iStr + " sync", false));
+      layout.add(std::make_unique<AudioParamBool>(
+          juce::ParameterID{globalId, 1}, "LFO " + iStr + " global", false));
       juce::StringArray waves;
       waves.add("Sine");
       waves.add("Square");
@@ -133,6 +137,22 @@ public:
           juce::ParameterID{targetId, 1}, targetName, targets, 0));
     }
 
+    auto sources = ModSource::getNames();
+    auto dests = ModDest::getNames();
+    for (int i = 0; i < NUM_MOD_SLOTS; ++i) {
+      auto iStr = juce::String(i);
+      String slotName = "Mod slot " + iStr;
+      layout.add(std::make_unique<AudioParamChoice>(
+          juce::ParameterID{ID::modSource + iStr, 1}, slotName + " source",
+          sources, 0));
+      layout.add(std::make_unique<AudioParamChoice>(
+          juce::ParameterID{ID::modDest + iStr, 1}, slotName + " destination",
+          dests, 0));
+      layout.add(std::make_unique<AudioParamFloat>(
+          juce::ParameterID{ID::modDepth + iStr, 1}, slotName + " depth",
+          -1.0f, 1.0f, 0.0f));
+    }
+
     for (int i = 0; i < NUM_OPERATORS; ++i) {
       juce::String iStr = juce::String(i);
       //! ocsillator parameters first
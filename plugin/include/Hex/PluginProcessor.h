@@ -12,6 +12,7 @@
 #include "DebugUtil.h"
 #include "HexState.h"
 #include "Audio/Synthesizer.h"
+#include "Audio/Telemetry.h"
 #include "juce_audio_basics/juce_audio_basics.h"
 //==============================================================================
 /**
@@ -57,10 +58,18 @@ public:
   juce::MidiKeyboardState masterKbdState;
   HexState tree;
   HexSynth synth;
+  //! feeds the CPU meter in the editor
+  Telemetry telemetry;
 
 private:
+  //! renders one block of at most preparedBlockSize samples
+  void renderSynth(juce::AudioBuffer<float>& buffer,
+                   juce::MidiBuffer& midiMessages);
   AsyncDebugPrinter printer;
   juce::AudioProcessorEditor* createdEditor;
+  int preparedBlockSize;
+  //! the events for one piece of a block bigger than preparedBlockSize
+  juce::MidiBuffer chunkMidi;
   //==============================================================================
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(HexAudioProcessor)
 };
@@ -0,0 +1,71 @@
+//===================================================
+#include "GUI/CpuMeter.h"
+#include "GUI/Color.h"
+#include "GUI/Fonts.h"
+
+CpuMeter::CpuMeter(Telemetry* t)
+    : telemetry(t),
+      averagePercent(0.0f),
+      peakPercent(0.0f),
+      voices(0),
+      nearXruns(0),
+      xruns(0) {
+  setTooltip("Audio thread CPU, active voices and near/actual xruns. Click to "
+             "reset the counts");
+  startTimerHz(12);
+}
+
+CpuMeter::~CpuMeter() {
+  telemetry->setEnabled(false);
+}
+
+void CpuMeter::visibilityChanged() {
+  telemetry->setEnabled(isVisible());
+}
+
+void CpuMeter::mouseDown(const juce::MouseEvent& e) {
+  juce::ignoreUnused(e);
+  telemetry->resetCounters();
+}
+
+void CpuMeter::timerCallback() {
+  float total = 0.0f;
+  float peak = 0.0f;
+  int numBlocks = 0;
+  telemetry->readBlocks([&](const BlockTelemetry& block) {
+    total += block.budgetPercent;
+    peak = std::max(peak, block.budgetPercent);
+    voices = block.activeVoices;
+    ++numBlocks;
+  });
+  if (numBlocks > 0)
+    averagePercent = (0.7f * averagePercent) + (0.3f * total / numBlocks);
+  peakPercent = peak;
+  nearXruns = telemetry->getNumNearXruns();
+  xruns = telemetry->getNumXruns();
+  repaint();
+}
+
+void CpuMeter::paint(juce::Graphics& g) {
+  auto fBounds = getLocalBounds().toFloat();
+  g.setColour(UIColor::shadowGray);
+  g.fillRect(fBounds);
+  // the bar shows the average, the tick the peak
+  auto barBounds = fBounds.removeFromBottom(fBounds.getHeight() * 0.2f);
+  const float avgWidth =
+      barBounds.getWidth() * std::min(averagePercent / 100.0f, 1.0f);
+  const bool overloaded = peakPercent > Telemetry::nearXrunPercent;
+  g.setColour(overloaded ? UIColor::orangeLight : UIColor::greenLight);
+  g.fillRect(barBounds.withWidth(avgWidth));
+  const float peakX = barBounds.getX() + (barBounds.getWidth() *
+                                          std::min(peakPercent / 100.0f, 1.0f));
+  g.setColour(UIColor::offWhite);
+  g.drawVerticalLine((int)peakX, barBounds.getY(), barBounds.getBottom());
+
+  String text = "CPU " + String(averagePercent, 1) + "%  " +
+                String(voices) + " voices  " + String(nearXruns) + " near / " +
+                String(xruns) + " xruns";
+  g.setFont(Fonts::getFont(Fonts::RobotoLight, fBounds.getHeight() * 0.8f));
+  g.setColour(xruns > 0 ? UIColor::orangeLight : UIColor::offWhite);
+  g.drawText(text, fBounds, juce::Justification::centred);
+}
@@ -28,104 +28,127 @@ float gainForVelocity(float vel) {
 
 }  // namespace VelTracking
 //=========================================================================
+namespace EnvCurve {
+static float exponent() {
+  static const float midAtkGain = juce::Decibels::decibelsToGain(-6.0f);
+  static const float curveExp = std::log(midAtkGain) / std::log(0.5f);
+  return curveExp;
+}
+
+// one extra point at the end so that interpolating at x = 1 stays in bounds
+static const std::array<float, TABLE_SIZE + 1>& getTable() {
+  static const auto table = [] {
+    std::array<float, TABLE_SIZE + 1> t;
+    for (size_t i = 0; i <= TABLE_SIZE; ++i)
+      t[i] = std::powf((float)i / (float)TABLE_SIZE, exponent());
+    return t;
+  }();
+  return table;
+}
+
+float at(float x) {
+  static const auto& table = getTable();
+  const float pos = std::clamp(x, 0.0f, 1.0f) * (float)TABLE_SIZE;
+  const size_t idx = std::min((size_t)pos, TABLE_SIZE - 1);
+  const float frac = pos - (float)idx;
+  return table[idx] + ((table[idx + 1] - table[idx]) * frac);
+}
+
+float inverse(float level) {
+  return std::powf(std::clamp(level, 0.0f, 1.0f), 1.0f / exponent());
+}
+}  // namespace EnvCurve
+//=========================================================================
 static size_t msToSamples(float ms) {
   return (size_t)((ms / 1000.0f) * (float)SampleRate::get());
 }
 
-void SharedEnvData::computeLUTs() {
+static float stepForLength(size_t samples) {
+  return (samples > 0) ? 1.0f / (float)samples : 1.0f;
+}
+
+EnvSegments SharedEnvData::computeSegments() const {
+  EnvSegments seg;
   // 1. figure out the length in samples for each
   // section
-  delaySamples = msToSamples(delayMs);
-  attackSamples = msToSamples(attackMs);
-  decaySamples = msToSamples(decayMs);
-  holdSamples = msToSamples(holdMs);
-  releaseSamples = msToSamples(releaseMs);
+  seg.delaySamples = msToSamples(delayMs.load());
+  seg.attackSamples = msToSamples(attackMs.load());
+  seg.decaySamples = msToSamples(decayMs.load());
+  seg.holdSamples = msToSamples(holdMs.load());
+  seg.releaseSamples = msToSamples(releaseMs.load());
+  // 2. and how far along the curve each sample moves
+  seg.attackStep = stepForLength(seg.attackSamples);
+  seg.decayStep = stepForLength(seg.decaySamples);
+  seg.releaseStep = stepForLength(seg.releaseSamples);
+  seg.sustainLevel = sustainLevel.load();
+  return seg;
+}
 
-  // 2. calculate the attack LUT
-  static const float midAtkGain = juce::Decibels::decibelsToGain(-6.0f);
-  const float attackExp = std::log(midAtkGain) / std::log(0.5f);
-  float dX = 1.0f / (float)attackSamples;
-  float xPos = 0.0f;
-  for (size_t i = 0; i < attackSamples; ++i) {
-    attackLut[i] = std::powf(xPos, attackExp);
-    xPos += dX;
-  }
-  //  3. calculate the decay curve
-  dX = 1.0f / (float)decaySamples;
-  const float decayHeight = 1.0f - sustainLevel;
-  const float decayExp = attackExp;
-  xPos = 1.0f;
-  for (size_t i = 0; i < decaySamples; ++i) {
-    decayLut[i] = sustainLevel + (std::powf(xPos, decayExp) * decayHeight);
-    xPos -= dX;
-  }
-  // 4. same for the release curve
-  const float releaseExp = decayExp;
-  dX = 1.0f / (float)releaseSamples;
-  xPos = 1.0f;
-  for (size_t i = 0; i < releaseSamples; ++i) {
-    releaseLut[i] = std::powf(xPos, releaseExp) * sustainLevel;
-    xPos -= dX;
-  }
+void SharedEnvData::publishSegments() {
+  auto* next = new EnvSegments(computeSegments());
+  auto* prev = segments.exchange(next);
+  // a block that starts after the exchange can only see the new set. If no
+  // block is running (even epoch) nothing can be reading prev, otherwise it
+  // has to wait until the epoch moves past the running block
+  const uint64_t now = audioEpoch.load();
+  std::erase_if(retired, [now](const Retired& r) { return r.epoch < now; });
+  if ((now & 1) == 0)
+    delete prev;
+  else
+    retired.push_back({std::unique_ptr<const EnvSegments>(prev), now});
 }
 
 size_t SharedEnvData::sampleIdxForRetrig(float level) const {
-  size_t left = 0;
-  size_t right = attackSamples - 1;
-  while (left <= right) {
-    auto mid = left + (right - left) / 2;
-    if (attackLut[mid] <= level && attackLut[mid + 1] > level) {
-      const float diff1 = std::fabs(level - attackLut[mid]);
-      const float diff2 = std::fabs(level - attackLut[mid + 1]);
-      return (diff1 < diff2) ? mid : mid + 1;
-    } else if (attackLut[mid] < level) {
-      left = mid + 1;
-    } else {
-      right = mid - 1;
-    }
-  }
-  jassert(false);
-  return 0;
+  const auto& seg = getSegments();
+  if (seg.attackSamples == 0)
+    return 0;
+  const float pos = EnvCurve::inverse(level) * (float)seg.attackSamples;
+  return std::min((size_t)std::lround(pos), seg.attackSamples - 1);
 }
 
-float SharedEnvData::nextValue(EnvPhase& phase, size_t& samplesInPhase) const {
+float SharedEnvData::nextValue(const EnvSegments& seg,
+                               EnvPhase& phase,
+                               size_t& samplesInPhase) {
   ++samplesInPhase;
   switch (phase) {
     case delayPhase:
-      if (samplesInPhase >= delaySamples) {
+      if (samplesInPhase >= seg.delaySamples) {
         phase = attackPhase;
         samplesInPhase = 0;
       }
       return 0.0f;
     case attackPhase:
-      if (samplesInPhase >= attackSamples) {
+      if (samplesInPhase >= seg.attackSamples) {
         phase = holdPhase;
         samplesInPhase = 0;
         return 1.0f;
       }
-      return attackLut[samplesInPhase];
+      return EnvCurve::at((float)samplesInPhase * seg.attackStep);
     case holdPhase:
-      if (samplesInPhase >= holdSamples) {
+      if (samplesInPhase >= seg.holdSamples) {
         phase = decayPhase;
         samplesInPhase = 0;
       }
       return 1.0f;
     case decayPhase:
-      if (samplesInPhase >= decaySamples) {
+      if (samplesInPhase >= seg.decaySamples) {
         phase = sustainPhase;
         samplesInPhase = 0;
-        return sustainLevel;
+        return seg.sustainLevel;
       }
-      return decayLut[samplesInPhase];
+      return seg.sustainLevel +
+             (EnvCurve::at(1.0f - ((float)samplesInPhase * seg.decayStep)) *
+              (1.0f - seg.sustainLevel));
     case sustainPhase:
-      return sustainLevel;
+      return seg.sustainLevel;
     case releasePhase:
-      if (samplesInPhase >= releaseSamples) {
+      if (samplesInPhase >= seg.releaseSamples) {
         phase = noteOff;
         samplesInPhase = 0;
         return 0.0f;
       }
-      return releaseLut[samplesInPhase];
+      return EnvCurve::at(1.0f - ((float)samplesInPhase * seg.releaseStep)) *
+             seg.sustainLevel;
     case noteOff:
       return 0.0f;
   }
@@ -133,50 +156,42 @@ float SharedEnvData::nextValue(EnvPhase& phase, size_t& samplesInPhase) const {
   return 0.0f;
 }
 
-void SharedEnvData::setDelay(float delay) {
-  if (!fequal(delay, delayMs)) {
-    delayMs = delay;
+void SharedEnvData::setParam(std::atomic<float>& param, float value) {
+  if (!fequal(value, param.load())) {
+    param.store(value);
     triggerAsyncUpdate();
   }
 }
 
+void SharedEnvData::setDelay(float delay) {
+  setParam(delayMs, delay);
+}
+
 void SharedEnvData::setAttack(float attack) {
-  if (!fequal(attack, attackMs)) {
-    attackMs = attack;
-    triggerAsyncUpdate();
-  }
+  setParam(attackMs, attack);
 }
 
 void SharedEnvData::setHold(float hold) {
-  if (!fequal(hold, holdMs)) {
-    holdMs = hold;
-    triggerAsyncUpdate();
-  }
+  setParam(holdMs, hold);
 }
 
 void SharedEnvData::setDecay(float decay) {
-  if (!fequal(decay, decayMs)) {
-    decayMs = decay;
-    triggerAsyncUpdate();
-  }
+  setParam(decayMs, decay);
 }
 
 void SharedEnvData::setSustain(float level) {
-  if (!fequal(level, sustainLevel)) {
-    sustainLevel = level;
-    triggerAsyncUpdate();
-  }
+  setParam(sustainLevel, level);
 }
 
 void SharedEnvData::setRelease(float release) {
-  if (!fequal(release, releaseMs)) {
-    releaseMs = release;
-    triggerAsyncUpdate();
-  }
+  setParam(releaseMs, release);
 }
 
-SharedEnvData::SharedEnvData() {
-  computeLUTs();
+SharedEnvData::SharedEnvData() : segments(new EnvSegments(computeSegments())) {}
+
+SharedEnvData::~SharedEnvData() {
+  cancelPendingUpdate();
+  delete segments.load();
 }
 //=========================================================================
 
@@ -184,6 +199,7 @@ VoiceEnvelope::VoiceEnvelope(SharedEnvData* d) : envData(d) {}
 
 void VoiceEnvelope::triggerOn(float velocity) {
   vGain = VelTracking::gainForVelocity(velocity);
+  inKillQuick = false;
   if (currentPhase != noteOff) {
     currentPhase = attackPhase;
     sampleIdx = envData->sampleIdxForRetrig(lastLevel);
@@ -204,14 +220,43 @@ void VoiceEnvelope::killQuick() {
   KQdelta = lastLevel / (float)lengthSamples;
 }
 
+void VoiceEnvelope::reset() {
+  currentPhase = noteOff;
+  sampleIdx = 0;
+  lastLevel = 0.0f;
+  inKillQuick = false;
+}
+
+void VoiceEnvelope::stepKillQuick() {
+  lastLevel -= KQdelta;
+  if (lastLevel <= 0.0f) {
+    lastLevel = 0.0f;
+    inKillQuick = false;
+    currentPhase = noteOff;
+  }
+}
+
 float VoiceEnvelope::process(float input) {
   if (inKillQuick) {
-    lastLevel -= KQdelta;
-    inKillQuick = lastLevel > 0.0f;
+    stepKillQuick();
   } else {
-    lastLevel = envData->nextValue(currentPhase, sampleIdx) * vGain;
+    lastLevel = SharedEnvData::nextValue(envData->getSegments(), currentPhase,
+                                         sampleIdx) *
+                vGain;
   }
   return input * lastLevel;
 }
 
+void VoiceEnvelope::renderLevels(float* dest, int numSamples) {
+  const auto& seg = envData->getSegments();
+  for (int i = 0; i < numSamples; ++i) {
+    if (inKillQuick) {
+      stepKillQuick();
+    } else {
+      lastLevel = SharedEnvData::nextValue(seg, currentPhase, sampleIdx) * vGain;
+    }
+    dest[i] = lastLevel;
+  }
+}
+
 //=========================================================================
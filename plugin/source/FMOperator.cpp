@@ -16,7 +16,14 @@ FMOperator::FMOperator(int opIndex, EnvelopeLUTGroup* luts)
     : audible(false),
       index(opIndex),
       vEnv(&luts->operatorEnv[opIndex]),
+      ratioParam(RATIO_DEFAULT),
+      modIndexParam(0.0f),
+      panParam(0.5f),
+      ratioMod(0.0f),
+      modIndexMod(0.0f),
+      panMod(0.0f),
       modIndex(0.0f),
+      baseRatio(RATIO_DEFAULT),
       modOffset(0.0f),
       pan(0.5f),
       level(1.0f),
@@ -43,3 +50,23 @@ void FMOperator::tick(double fundamental, float modValue) {
   lastOutL = lastOutMono * pan;
   lastOutR = lastOutMono * (1.0f - pan);
 }
+
+void FMOperator::tickAtGain(double fundamental, float gain) {
+  lastOutMono = vEnv.process(
+      oscillator.getSample((fundamental * baseRatio) + (modIndex * modOffset)) *
+      gain);
+  lastOutL = lastOutMono * pan;
+  lastOutR = lastOutMono * (1.0f - pan);
+}
+
+void FMOperator::renderUnmodulated(float* dest,
+                                   double fundamental,
+                                   const float* gains,
+                                   const float* envLevels,
+                                   int numSamples) {
+  oscillator.renderBlock(dest, numSamples, fundamental * baseRatio);
+  for (int i = 0; i < numSamples; ++i)
+    dest[i] = (dest[i] * gains[i]) * envLevels[i];
+  if (numSamples > 0)
+    lastOutMono = dest[numSamples - 1];
+}
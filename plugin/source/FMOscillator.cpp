@@ -59,31 +59,77 @@ std::array<float, TABLESIZE> WTArray::makeArray(WaveType type) {
   }
   return arr;
 }
+
+const float* WTArray::getSharedSine() {
+  static const auto table = makeArray(Sine);
+  return table.data();
+}
 //==============================================================================
-SineOsc::SineOsc()
-    : phase(0.0f), phaseDelta(0.0f), skew(0.0f), lowerIdx(0), upperIdx(0) {
-  auto dPhase = juce::MathConstants<float>::twoPi / (float)TABLESIZE;
-  for (int i = 0; i < TABLESIZE; ++i) {
-    sineData[i] = std::sin(dPhase * (float)i);
-  }
+static constexpr uint32_t tableMask = TABLESIZE - 1;
+static constexpr uint32_t fracMask = (1u << PhaseAccumulator::fracBits) - 1;
+static constexpr float fracScale = 1.0f / (float)(1u << PhaseAccumulator::fracBits);
+
+float TableRead::linear(const float* table, uint32_t phase) {
+  const uint32_t idx = phase >> PhaseAccumulator::fracBits;
+  const float frac = (float)(phase & fracMask) * fracScale;
+  const float y0 = table[idx];
+  const float y1 = table[(idx + 1) & tableMask];
+  return y0 + ((y1 - y0) * frac);
+}
+
+float TableRead::cubic(const float* table, uint32_t phase) {
+  // 4 point, 3rd order Hermite
+  const uint32_t idx = phase >> PhaseAccumulator::fracBits;
+  const float frac = (float)(phase & fracMask) * fracScale;
+  const float ym1 = table[(idx - 1) & tableMask];
+  const float y0 = table[idx];
+  const float y1 = table[(idx + 1) & tableMask];
+  const float y2 = table[(idx + 2) & tableMask];
+  const float c1 = 0.5f * (y1 - ym1);
+  const float c2 = ym1 - (2.5f * y0) + (2.0f * y1) - (0.5f * y2);
+  const float c3 = (0.5f * (y2 - ym1)) + (1.5f * (y0 - y1));
+  return (((c3 * frac + c2) * frac + c1) * frac) + y0;
 }
+//==============================================================================
+SineOsc::SineOsc() : sineData(WTArray::getSharedSine()) {}
 
 float SineOsc::getSample(double hz) {
-  if (hz > nyquist)
-    hz = nyquist;
-  if (hz < 10.0f)
-    hz = 10.0f;
-  phaseDelta = (float)(hz / sampleRate);
-  phase = fmod(phase + phaseDelta, 1.0f);
-  auto idx = (size_t)(phase * (float)(TABLESIZE - 1));
-  return sineData[idx];
+  acc.setFrequency(hz);
+  return TableRead::read(sineData, acc.next(), interp);
+}
+
+void SineOsc::renderBlock(float* dest, int numSamples, double hz) {
+  acc.setFrequency(hz);
+  if (interp == OscInterpolation::cubic) {
+    for (int i = 0; i < numSamples; ++i)
+      dest[i] = TableRead::cubic(sineData, acc.next());
+  } else {
+    for (int i = 0; i < numSamples; ++i)
+      dest[i] = TableRead::linear(sineData, acc.next());
+  }
+}
+
+void SineOsc::renderBlock(float* dest, const float* hz, int numSamples) {
+  for (int i = 0; i < numSamples; ++i)
+    dest[i] = getSample(hz[i]);
 }
 //==============================================================================
-AntiAliasOsc::AntiAliasOsc(WaveType type) : phase(0.0f), tablesAdded(0) {
+WaveTableSet::Ptr WaveTableSet::get(WaveType type) {
+  // built once for the whole process and never freed, so handing these out
+  // can never release the last reference on the audio thread. HexOsc plays
+  // sine and noise without tables, so only the other three get built
+  static const std::array<Ptr, 3> sets = [] {
+    std::array<Ptr, 3> arr;
+    for (int t = 0; t < 3; ++t)
+      arr[(size_t)t] = new WaveTableSet((WaveType)(Square + t));
+    return arr;
+  }();
+  jassert(type == Square || type == Saw || type == Tri);
+  return sets[(size_t)std::clamp((int)type - (int)Square, 0, 2)];
+}
+
+WaveTableSet::WaveTableSet(WaveType type) : numTables(0) {
   auto firstTable = WTArray::makeArray(type);
-  for (int i = 0; i < TABLES_PER_FRAME; ++i) {
-    tables.add(new Wavetable());  // fill the OwnedArray with empty tables
-  }
   float fReal[TABLESIZE];
   float fImag[TABLESIZE];
   for (size_t i = 0; i < TABLESIZE; ++i) {
@@ -94,7 +140,7 @@ AntiAliasOsc::AntiAliasOsc(WaveType type) : phase(0.0f), tablesAdded(0) {
   createTables(TABLESIZE, fReal, fImag);
 }
 
-void AntiAliasOsc::createTables(int _ts, float* real, float* imag) {
+void WaveTableSet::createTables(int _ts, float* real, float* imag) {
   size_t idx;
   size_t tableSize = (size_t)_ts;
   // zero DC offset and Nyquist (set first and last samples of each array to
@@ -133,14 +179,15 @@ void AntiAliasOsc::createTables(int _ts, float* real, float* imag) {
   }
 }
 
-float AntiAliasOsc::makeTable(float* waveReal,
+float WaveTableSet::makeTable(float* waveReal,
                               float* waveImag,
                               int numSamples,
                               float scale,
                               float bottomFreq,
                               float topFreq) {
-  tables[tablesAdded]->maxFreq = topFreq;
-  tables[tablesAdded]->minFreq = bottomFreq;
+  jassert(numTables < TABLES_PER_FRAME);
+  tables[numTables].maxFreq = topFreq;
+  tables[numTables].minFreq = bottomFreq;
   MathUtil::fft(numSamples, waveReal, waveImag);
   if (scale == 0.0f) {
     // get maximum value to scale to -1 - 1
@@ -151,67 +198,107 @@ float AntiAliasOsc::makeTable(float* waveReal,
         max = temp;
     }
     scale = 1.0f / (float)max * 0.999f;
-    // printf("Table: %d has scale: %f\n", tablesAdded, scale);
+    // printf("Table: %d has scale: %f\n", numTables, scale);
   }
   auto minLevel = std::numeric_limits<float>::max();
   auto maxLevel = std::numeric_limits<float>::min();
   for (int i = 0; i < numSamples; ++i) {
-    tables[tablesAdded]->table[i] = waveImag[i] * scale;
-    if (tables[tablesAdded]->table[i] < minLevel)
-      minLevel = tables[tablesAdded]->table[i];
-    if (tables[tablesAdded]->table[i] > maxLevel)
-      maxLevel = tables[tablesAdded]->table[i];
+    tables[numTables].table[i] = waveImag[i] * scale;
+    if (tables[numTables].table[i] < minLevel)
+      minLevel = tables[numTables].table[i];
+    if (tables[numTables].table[i] > maxLevel)
+      maxLevel = tables[numTables].table[i];
   }
   auto offset = maxLevel + minLevel;
   minLevel = std::numeric_limits<float>::max();
   maxLevel = std::numeric_limits<float>::min();
   for (int i = 0; i < numSamples; ++i) {
-    tables[tablesAdded]->table[i] -=
+    tables[numTables].table[i] -=
         (offset / 2.0f);  // make sure each table has no DC offset
-    if (tables[tablesAdded]->table[i] < minLevel)
-      minLevel = tables[tablesAdded]->table[i];
-    if (tables[tablesAdded]->table[i] > maxLevel)
-      maxLevel = tables[tablesAdded]->table[i];
+    if (tables[numTables].table[i] < minLevel)
+      minLevel = tables[numTables].table[i];
+    if (tables[numTables].table[i] > maxLevel)
+      maxLevel = tables[numTables].table[i];
   }
-  ++tablesAdded;
+  ++numTables;
   return (float)scale;
 }
 
-Wavetable* AntiAliasOsc::tableForHz(double hz) {
-  phaseDelta = (float)hz / (float)sampleRate;
-  for (auto table : tables) {
-    if (table->maxFreq > phaseDelta && table->minFreq <= phaseDelta)
-      return table;
+const Wavetable* WaveTableSet::tableForDelta(float phaseDelta) const {
+  for (int i = 0; i < numTables; ++i) {
+    if (tables[i].maxFreq > phaseDelta && tables[i].minFreq <= phaseDelta)
+      return &tables[i];
   }
-  return tables.getLast();
+  return &tables[numTables - 1];
+}
+//==============================================================================
+AntiAliasOsc::AntiAliasOsc(WaveType type)
+    : tables(WaveTableSet::get(type)), currentTable(tables->getTable(0)) {}
+
+void AntiAliasOsc::setWaveType(WaveType type) {
+  tables = WaveTableSet::get(type);
+  currentTable = tables->tableForDelta(
+      (float)(acc.getIncrement() / 4294967296.0));
 }
 
 float AntiAliasOsc::getSample(double hz) {
-  if (hz > nyquist)
-    hz = nyquist;
-  if (hz < 10.0f)
-    hz = 10.0f;
-  phaseDelta = (float)(hz / sampleRate);
-  phase = std::fmod(phase + phaseDelta, 1.0f);
-  auto table = tableForHz(hz);
-  bottomIndex = (int)(phase * (float)(TABLESIZE - 1));
-  return table->table[bottomIndex];
+  setFrequency(hz);
+  return TableRead::read(currentTable->table, acc.next(), interp);
+}
+
+void AntiAliasOsc::renderBlock(float* dest, int numSamples, double hz) {
+  setFrequency(hz);
+  const float* table = currentTable->table;
+  if (interp == OscInterpolation::cubic) {
+    for (int i = 0; i < numSamples; ++i)
+      dest[i] = TableRead::cubic(table, acc.next());
+  } else {
+    for (int i = 0; i < numSamples; ++i)
+      dest[i] = TableRead::linear(table, acc.next());
+  }
+}
+
+void AntiAliasOsc::renderBlock(float* dest, const float* hz, int numSamples) {
+  for (int i = 0; i < numSamples; ++i)
+    dest[i] = getSample(hz[i]);
 }
 //==============================================================================================
-HexOsc::HexOsc()
-    : currentType(Sine), waveOsc(std::make_unique<AntiAliasOsc>()) {}
+HexOsc::HexOsc() : requestedType((int)Sine), currentType(Sine) {}
 
-void HexOsc::setType(WaveType type) {
-  if (currentType != type) {
-    currentType = type;
-    triggerAsyncUpdate();
+void HexOsc::beginBlock() {
+  const auto type = (WaveType)requestedType.load(std::memory_order_relaxed);
+  if (currentType == type)
+    return;
+  currentType = type;
+  if (currentType == Sine) {
+    oMode = OscModeE::mSine;
+  } else if (currentType == Noise) {
+    oMode = OscModeE::mNoise;
+  } else {
+    oMode = OscModeE::mWave;
+    waveOsc.setWaveType(currentType);
+  }
+}
+
+void HexOsc::renderBlock(float* dest, int numSamples, double hz) {
+  switch (oMode) {
+    case OscModeE::mNoise:
+      for (int i = 0; i < numSamples; ++i)
+        dest[i] = nOsc.getSample(hz);
+      return;
+    case OscModeE::mSine:
+      sineOsc.renderBlock(dest, numSamples, hz);
+      return;
+    case OscModeE::mWave:
+      waveOsc.renderBlock(dest, numSamples, hz);
+      return;
   }
 }
 
 void HexOsc::setSampleRate(double rate) {
   sineOsc.setSampleRate(rate);
   nOsc.setSampleRate(rate);
-  waveOsc->setSampleRate(rate);
+  waveOsc.setSampleRate(rate);
 }
 
 float HexOsc::getSample(double hz) {
@@ -221,19 +308,8 @@ float HexOsc::getSample(double hz) {
     case OscModeE::mSine:
       return sineOsc.getSample(hz);
     case OscModeE::mWave:
-      return waveOsc->getSample(hz);
+      return waveOsc.getSample(hz);
   }
   jassert(false);
   return 0.0f;
 }
-
-void HexOsc::handleAsyncUpdate() {
-  if (currentType == Sine) {
-    oMode = OscModeE::mSine;
-  } else if (currentType == Noise) {
-    oMode = OscModeE::mNoise;
-  } else {
-    oMode = OscModeE::mWave;
-    waveOsc.reset(new AntiAliasOsc(currentType));
-  }
-}
@@ -10,48 +10,212 @@
 
 #include "Audio/Filter.h"
 #include "Audio/DAHDSR.h"
+SVFCoefficients SVFCoefficients::make(float cutoff,
+                                      float resonance,
+                                      double sampleRate) {
+  // keep the cutoff a little under nyquist so that g stays finite
+  const float maxCutoff = (float)(sampleRate * 0.49);
+  cutoff = std::clamp(cutoff, CUTOFF_MIN, maxCutoff);
+  SVFCoefficients c;
+  c.g = MathUtil::fastTan(PI_CONST * cutoff / (float)sampleRate);
+  c.r2 = 1.0f / resonance;
+  c.h = 1.0f / (1.0f + (c.r2 * c.g) + (c.g * c.g));
+  return c;
+}
+//==============================================================================
+void StereoSVF::reset() {
+  s1[0] = s1[1] = 0.0f;
+  s2[0] = s2[1] = 0.0f;
+  primed = false;
+}
+
+void StereoSVF::rampTo(float cutoff, float resonance, int numSamples) {
+  target = SVFCoefficients::make(cutoff, resonance, sampleRate);
+  if (!primed || numSamples < 1) {
+    coeffs = target;
+    primed = true;
+  }
+  const float scale = 1.0f / (float)std::max(numSamples, 1);
+  delta.g = (target.g - coeffs.g) * scale;
+  delta.r2 = (target.r2 - coeffs.r2) * scale;
+  delta.h = (target.h - coeffs.h) * scale;
+}
+
+void StereoSVF::setImmediate(float cutoff, float resonance) {
+  coeffs = target = SVFCoefficients::make(cutoff, resonance, sampleRate);
+  delta = SVFCoefficients{0.0f, 0.0f, 0.0f};
+  primed = true;
+}
+
+void StereoSVF::loadLanes(SVFLanes::Data& d,
+                          int firstLane,
+                          float wetLevel) const {
+  for (int c = 0; c < 2; ++c) {
+    const int l = firstLane + c;
+    d.s1[l] = s1[c];
+    d.s2[l] = s2[c];
+    d.g[l] = coeffs.g;
+    d.r2[l] = coeffs.r2;
+    d.h[l] = coeffs.h;
+    d.dg[l] = delta.g;
+    d.dr2[l] = delta.r2;
+    d.dh[l] = delta.h;
+    d.wet[l] = wetLevel;
+  }
+}
+
+void StereoSVF::storeLanes(const SVFLanes::Data& d, int firstLane) {
+  for (int c = 0; c < 2; ++c) {
+    s1[c] = d.s1[firstLane + c];
+    s2[c] = d.s2[firstLane + c];
+  }
+  // snapping to the target stops rounding in the ramp from adding up
+  coeffs = target;
+}
+
+template <FilterType type>
+float StereoSVF::tick(int channel, float input) {
+  const float g = coeffs.g;
+  const float hp =
+      coeffs.h * (input - (s1[channel] * (g + coeffs.r2)) - s2[channel]);
+  const float bp = (g * hp) + s1[channel];
+  s1[channel] = (g * hp) + bp;
+  const float lp = (g * bp) + s2[channel];
+  s2[channel] = (g * bp) + lp;
+  if constexpr (type == HiPass)
+    return hp;
+  else if constexpr (type == BandPass)
+    return bp;
+  else
+    return lp;
+}
+
+void StereoSVF::processSample(float& left, float& right, float wetLevel) {
+  switch (currentType) {
+    case None:
+      return;
+    case LoPass:
+      left = MathUtil::fLerp(left, tick<LoPass>(0, left), wetLevel);
+      right = MathUtil::fLerp(right, tick<LoPass>(1, right), wetLevel);
+      return;
+    case HiPass:
+      left = MathUtil::fLerp(left, tick<HiPass>(0, left), wetLevel);
+      right = MathUtil::fLerp(right, tick<HiPass>(1, right), wetLevel);
+      return;
+    case BandPass:
+      left = MathUtil::fLerp(left, tick<BandPass>(0, left), wetLevel);
+      right = MathUtil::fLerp(right, tick<BandPass>(1, right), wetLevel);
+      return;
+  }
+}
+//==============================================================================
 StereoFilter::StereoFilter(EnvelopeLUTGroup* luts, int voiceIdx)
     : env(&luts->filterEnv),
       cutoffVal(2500.0f),
+      envCutoff(2500.0f),
       resonanceVal(1.0f),
+      resonanceMod(0.0f),
       rateVal(44100.0f),
       envDepth(0.5f),
       wetLevel(1.0f),
       voiceIndex(voiceIdx),
+      requestedType((int)LoPass),
       currentType(LoPass),
-      lFilter(std::make_unique<LibLowPass>()),
-      rFilter(std::make_unique<LibLowPass>()) {}
-
-void StereoFilter::setType(int filterType) {
-  auto nType = (FilterType)filterType;
-  if (currentType != nType) {
-    currentType = nType;
-    triggerAsyncUpdate();
-  }
+      bypassed(false) {}
+
+void StereoFilter::beginBlock() {
+  const auto type = (FilterType)requestedType.load(std::memory_order_relaxed);
+  const bool bypass = type == None || wetLevel == 0.0f;
+  // whatever's left in the state is from before the filter was bypassed
+  if (bypassed && !bypass)
+    svf.reset();
+  bypassed = bypass;
+  if (type == currentType)
+    return;
+  currentType = type;
+  svf.setType(currentType);
 }
 
-void StereoFilter::handleAsyncUpdate() {
-  switch (currentType) {
+void StereoFilter::processSample(float& left, float& right, float modValue) {
+  if (bypassed)
+    return;
+  svf.setImmediate(applyMod(envCutoff, modValue), modulatedResonance());
+  svf.processSample(left, right, wetLevel);
+}
+
+void StereoFilter::processBlock(float* left,
+                                float* right,
+                                const float* envLevels,
+                                const float* lfoMod,
+                                int numSamples) {
+  auto* self = this;
+  processGroup(&self, &left, &right, &envLevels, &lfoMod, 1, numSamples);
+}
+
+static void runLanes(FilterType type, SVFLanes::Data& d, int numSamples) {
+  switch (type) {
     case None:
       return;
-    case LoPass: {
-      lFilter.reset(new LibLowPass());
-      rFilter.reset(new LibLowPass());
-      break;
+    case LoPass:
+      SVFLanes::process<SVFLanes::lowpass>(d, numSamples);
+      return;
+    case HiPass:
+      SVFLanes::process<SVFLanes::highpass>(d, numSamples);
+      return;
+    case BandPass:
+      SVFLanes::process<SVFLanes::bandpass>(d, numSamples);
+      return;
+  }
+}
+
+void StereoFilter::processGroup(StereoFilter* const* filters,
+                                float* const* left,
+                                float* const* right,
+                                const float* const* envLevels,
+                                const float* const* lfoMod,
+                                int numFilters,
+                                int numSamples) {
+  jassert(numFilters > 0 && numFilters <= maxGroupSize);
+  // the lanes all tap the same output, filters of different types (only
+  // possible for a block while a type change is going through) go one by one
+  const FilterType type = filters[0]->currentType;
+  const bool bypass = filters[0]->bypassed;
+  for (int f = 1; f < numFilters; ++f) {
+    if (filters[f]->currentType != type || filters[f]->bypassed != bypass) {
+      for (int n = 0; n < numFilters; ++n) {
+        processGroup(&filters[n], &left[n], &right[n], &envLevels[n],
+                     &lfoMod[n], 1, numSamples);
+      }
+      return;
     }
-    case HiPass: {
-      lFilter.reset(new LibHiPass());
-      rFilter.reset(new LibHiPass());
-      break;
+  }
+  if (bypass)
+    return;
+  // unused lanes stay zeroed and filter silence
+  SVFLanes::Data lanes = {};
+  constexpr int interval = StereoSVF::controlInterval;
+  for (int i = 0; i < numSamples; i += interval) {
+    const int length = std::min(interval, numSamples - i);
+    // aim for the cutoff at the end of this stretch
+    const int last = i + length - 1;
+    for (int f = 0; f < numFilters; ++f) {
+      auto* filter = filters[f];
+      const float modValue = (lfoMod[f] != nullptr) ? lfoMod[f][last] : 0.0f;
+      filter->svf.rampTo(filter->cutoffFor(envLevels[f][last], modValue),
+                         filter->modulatedResonance(), length);
+      filter->svf.loadLanes(lanes, 2 * f, filter->wetLevel);
+      for (int s = 0; s < length; ++s) {
+        lanes.x[s][2 * f] = left[f][i + s];
+        lanes.x[s][(2 * f) + 1] = right[f][i + s];
+      }
     }
-    case BandPass: {
-      lFilter.reset(new LibBandPass());
-      rFilter.reset(new LibBandPass());
-      break;
+    runLanes(type, lanes, length);
+    for (int f = 0; f < numFilters; ++f) {
+      filters[f]->svf.storeLanes(lanes, 2 * f);
+      for (int s = 0; s < length; ++s) {
+        left[f][i + s] = lanes.x[s][2 * f];
+        right[f][i + s] = lanes.x[s][(2 * f) + 1];
+      }
     }
   }
-  //! make sure these parameters stay the same when the unique_ptr gets reset
-  setSampleRate(rateVal);
-  setCutoff(cutoffVal);
-  setResonance(resonanceVal);
 }
@@ -160,7 +160,7 @@ HexEditor::HexEditor(HexAudioProcessor* proc,
       graph(params, buffer),
       fPanel(tree, params),
       kbdBar(linkedTree, kbdState),
-      upperBar(tree),
+      upperBar(tree, &proc->telemetry),
       saveDialog(tree),
       loadDialog(tree) {
   setLookAndFeel(&lnf);
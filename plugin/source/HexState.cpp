@@ -7,6 +7,7 @@ HexState::HexState(juce::AudioProcessor* proc)
                nullptr,
                ID::HEX_STATE_TREE,
                HexParameters::createLayout()),
+      params(mainTree),
       patchTree(ID::HEX_PATCH_INFO) {
   patchTree.setProperty(ID::patchName, "Untitled", nullptr);
   patchTree.setProperty(ID::patchAuthor, "User", nullptr);
@@ -9,6 +9,7 @@
 */
 
 #include "Audio/LFO.h"
+#include "Audio/FMOperator.h"
 #include "HexHeader.h"
 #include "Identifiers.h"
 #include "MathUtil.h"
@@ -58,41 +59,50 @@ LfoArray WaveArray::arrayForType(WaveType type) {
   }
   return array;
 }
+
+const LfoArray& WaveArray::sharedArray(WaveType type) {
+  static const std::array<LfoArray, 4> arrays = [] {
+    std::array<LfoArray, 4> arr;
+    for (int t = 0; t < 4; ++t)
+      arr[(size_t)t] = arrayForType((WaveType)t);
+    return arr;
+  }();
+  // noise doesn't read a table
+  return arrays[std::min((size_t)type, arrays.size() - 1)];
+}
 //====================================================================================
 HexLfo::HexLfo(int idx)
     : lfoIndex(idx),
+      requestedType((int)Sine),
       currentType(Sine),
-      waveOsc(std::make_unique<WaveLfo>(currentType)),
-      sampleRate(44100.0f),
-      currentRate(1.0f) {}
-void HexLfo::setType(int type) {
-  //! type changes
-  if (type != (int)currentType) {
-    currentType = (WaveType)type;
-    triggerAsyncUpdate();
-  }
-}
+      waveOscs{WaveLfo(Sine), WaveLfo(Square), WaveLfo(Saw), WaveLfo(Tri)} {}
 
-void HexLfo::handleAsyncUpdate() {
-  if (currentType != Noise)
-    waveOsc.reset(new WaveLfo(currentType));
-  //! Make sure other parameters stay the same when the type gets changed
-  waveOsc->setSampleRate(sampleRate);
-  waveOsc->setRate(currentRate);
+void HexLfo::beginBlock() {
+  const auto type = (WaveType)requestedType.load(std::memory_order_relaxed);
+  if (type == currentType)
+    return;
+  // carry the phase over so a shape change doesn't restart the cycle
+  if (currentType != Noise && type != Noise) {
+    waveOscs[(size_t)type].setPhase(
+        waveOscs[(size_t)currentType].getPhase());
+  }
+  currentType = type;
 }
 
 void HexLfo::setRate(float _rate) {
-  waveOsc->setRate(_rate);
+  for (auto& osc : waveOscs)
+    osc.setRate(_rate);
+  noiseOsc.setRate(_rate);
 }
 
 void HexLfo::setSampleRate(double rate) {
-  sampleRate = rate;
-  waveOsc->setSampleRate(rate);
+  for (auto& osc : waveOscs)
+    osc.setSampleRate(rate);
   noiseOsc.setSampleRate(rate);
 }
 float HexLfo::tick() {
   if (currentType != Noise) {
-    return waveOsc->tick();
+    return waveOscs[(size_t)currentType].tick();
   } else {
     return noiseOsc.tick();
   }
@@ -100,3 +110,25 @@ float HexLfo::tick() {
 float HexLfo::tickToValue(float baseValue, float maxValue, float depth) {
   return MathUtil::fLerp(baseValue, maxValue, tick() * depth);
 }
+//====================================================================================
+GlobalLfoBank::GlobalLfoBank() : buffer(NUM_LFOS, 512) {
+  for (int i = 0; i < NUM_LFOS; ++i)
+    lfos.add(new HexLfo(i));
+  buffer.clear();
+}
+
+void GlobalLfoBank::prepare(double sampleRate, int maxBlockSize) {
+  for (auto lfo : lfos)
+    lfo->setSampleRate(sampleRate);
+  buffer.setSize(NUM_LFOS, maxBlockSize);
+  buffer.clear();
+}
+
+void GlobalLfoBank::render(int lfoIdx, int startSample, int numSamples) {
+  // HexAudioProcessor splits up blocks bigger than the prepared size
+  jassert(startSample + numSamples <= buffer.getNumSamples());
+  auto* lfo = lfos[lfoIdx];
+  auto* dest = buffer.getWritePointer(lfoIdx);
+  for (int i = startSample; i < startSample + numSamples; ++i)
+    dest[i] = lfo->tick();
+}
@@ -177,6 +177,8 @@ LfoComponent::LfoComponent(int i,
   rateAttach.reset(new sliderAttach(*linkedTree, rateId, rateSlider));
   auto syncId = ID::lfoSync + iStr;
   syncAttach.reset(new buttonAttach(*linkedTree, syncId, bpmToggle));
+  auto globalId = ID::lfoGlobal + iStr;
+  globalAttach.reset(new buttonAttach(*linkedTree, globalId, globalToggle));
   auto targetId = ID::lfoTarget + iStr;
   targetAttach.reset(new comboBoxAttach(*linkedTree, targetId, targetBox));
   auto depthId = ID::lfoDepth + iStr;
@@ -192,6 +194,10 @@ LfoComponent::LfoComponent(int i,
   bpmToggle.setClickingTogglesState(true);
   bpmToggle.addListener(this);
 
+  addAndMakeVisible(&globalToggle);
+  globalToggle.setButtonText("Global");
+  globalToggle.setClickingTogglesState(true);
+
   addAndMakeVisible(&rateSlider);
   rateSlider.setSliderStyle(juce::Slider::Rotary);
   rateSlider.setTextBoxStyle(juce::Slider::NoTextBox, true, 1, 1);
@@ -282,6 +288,8 @@ void LfoComponent::resized() {
   depthSlider.setBounds(depthBounds.toNearestInt());
   frect_t syncBounds = {6.0f * xScale, 123.0f * yScale, 45.0f * xScale, 20.0f * yScale};
   bpmToggle.setBounds(syncBounds.toNearestInt());
+  frect_t globalBounds = {56.0f * xScale, 123.0f * yScale, 50.0f * xScale, 20.0f * yScale};
+  globalToggle.setBounds(globalBounds.toNearestInt());
 
 
 }
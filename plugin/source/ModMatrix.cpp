@@ -0,0 +1,90 @@
+//===================================================
+#include "Audio/ModMatrix.h"
+#include "Audio/Filter.h"
+
+juce::StringArray ModSource::getNames() {
+  juce::StringArray names;
+  names.add("None");
+  for (int i = 0; i < NUM_LFOS; ++i)
+    names.add("LFO " + juce::String(i + 1));
+  for (int i = 0; i < NUM_OPERATORS; ++i)
+    names.add("Envelope " + juce::String(i + 1));
+  names.add("Filter Envelope");
+  names.add("Velocity");
+  names.add("Mod Wheel");
+  jassert(names.size() == numSources);
+  return names;
+}
+
+bool ModDest::isBlockRate(int dest) {
+  if (dest == filterResonance)
+    return true;
+  if (dest == none || dest >= filterCutoff)
+    return false;
+  return opParam(dest) != opLevel;
+}
+
+juce::StringArray ModDest::getNames() {
+  juce::StringArray names;
+  names.add("None");
+  for (int i = 0; i < NUM_OPERATORS; ++i) {
+    auto prefix = "Operator " + juce::String(i + 1) + " ";
+    names.add(prefix + "Ratio");
+    names.add(prefix + "Mod Index");
+    names.add(prefix + "Level");
+    names.add(prefix + "Pan");
+  }
+  names.add("Filter Cutoff");
+  names.add("Filter Resonance");
+  jassert(names.size() == numDests);
+  return names;
+}
+
+// how far a depth of 1 moves each destination
+static float destRange(int dest) {
+  if (dest == ModDest::filterCutoff)
+    return 1.0f;  // the whole way to CUTOFF_MAX (or CUTOFF_MIN)
+  if (dest == ModDest::filterResonance)
+    return RESONANCE_MAX - RESONANCE_MIN;
+  switch (ModDest::opParam(dest)) {
+    case ModDest::opRatio:
+      return 2.0f;  // octaves
+    case ModDest::opModIndex:
+      return MODINDEX_MAX;
+    default:
+      return 1.0f;
+  }
+}
+
+ModRouteList ModRouteList::compile(const Slots& slots) {
+  ModRouteList list;
+  for (auto& s : slots) {
+    if (s.source == ModSource::none || s.dest == ModDest::none ||
+        s.depth == 0.0f)
+      continue;
+    list.routes[(size_t)list.numRoutes++] = {s.source, s.dest,
+                                             s.depth * destRange(s.dest)};
+  }
+  auto* first = list.routes.data();
+  std::stable_sort(first, first + list.numRoutes,
+                   [](const ModRoute& a, const ModRoute& b) {
+                     return a.dest < b.dest;
+                   });
+  for (int r = 0; r < list.numRoutes; ++r) {
+    if (r > 0 && list.routes[(size_t)r].dest == list.routes[(size_t)r - 1].dest)
+      continue;
+    list.dests[(size_t)list.numDests] = list.routes[(size_t)r].dest;
+    list.destStart[(size_t)list.numDests] = r;
+    ++list.numDests;
+  }
+  list.destStart[(size_t)list.numDests] = list.numRoutes;
+  return list;
+}
+
+bool ModRouteList::usesSource(int source) const {
+  for (int r = 0; r < numRoutes; ++r) {
+    if (routes[(size_t)r].source == source)
+      return true;
+  }
+  return false;
+}
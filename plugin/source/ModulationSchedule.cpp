@@ -0,0 +1,81 @@
+//===================================================
+#include "Audio/ModulationSchedule.h"
+
+ModulationSchedule::ModulationSchedule() : numEdges(0), numFeedbackEdges(0) {
+  for (int i = 0; i < NUM_OPERATORS; ++i) {
+    order[(size_t)i] = i;
+  }
+  edgeStart.fill(0);
+}
+
+ModulationSchedule ModulationSchedule::compile(const RoutingGrid& grid) {
+  ModulationSchedule sched;
+  // 1. count how many (non self) modulators each operator is waiting on
+  int pending[NUM_OPERATORS];
+  for (size_t dst = 0; dst < NUM_OPERATORS; ++dst) {
+    pending[dst] = 0;
+    for (size_t src = 0; src < NUM_OPERATORS; ++src) {
+      if (grid[src][dst] && src != dst)
+        ++pending[dst];
+    }
+  }
+  // 2. Kahn's algorithm. Ties go to the lowest operator index and a cycle
+  // gets broken at its lowest-indexed operator, so the same grid always
+  // compiles to the same schedule
+  bool evaluated[NUM_OPERATORS] = {};
+  for (size_t k = 0; k < NUM_OPERATORS; ++k) {
+    int next = -1;
+    for (int o = 0; o < NUM_OPERATORS; ++o) {
+      if (!evaluated[o] && pending[o] == 0) {
+        next = o;
+        break;
+      }
+    }
+    if (next == -1) {
+      for (int o = 0; o < NUM_OPERATORS; ++o) {
+        if (!evaluated[o]) {
+          next = o;
+          break;
+        }
+      }
+    }
+    sched.order[k] = next;
+    // 3. this operator's incoming edges. Anything coming from an operator
+    // that hasn't been evaluated yet has to be a feedback edge
+    sched.edgeStart[k] = sched.numEdges;
+    for (int src = 0; src < NUM_OPERATORS; ++src) {
+      if (grid[(size_t)src][(size_t)next]) {
+        const bool delayed = !evaluated[src] || src == next;
+        sched.edges[(size_t)sched.numEdges] = {src, next, delayed};
+        ++sched.numEdges;
+        if (delayed)
+          ++sched.numFeedbackEdges;
+      }
+    }
+    evaluated[next] = true;
+    for (size_t dst = 0; dst < NUM_OPERATORS; ++dst) {
+      if (grid[(size_t)next][dst] && (int)dst != next)
+        --pending[dst];
+    }
+  }
+  sched.edgeStart[NUM_OPERATORS] = sched.numEdges;
+  return sched;
+}
+
+uint32_t ModulationSchedule::liveOperators(uint32_t audibleMask) const {
+  uint32_t live = audibleMask;
+  // feedback edges can point backwards, so go until nothing else turns up
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int e = 0; e < numEdges; ++e) {
+      const auto& edge = edges[(size_t)e];
+      const uint32_t srcBit = 1u << edge.src;
+      if ((live & (1u << edge.dst)) && !(live & srcBit)) {
+        live |= srcBit;
+        changed = true;
+      }
+    }
+  }
+  return live;
+}
@@ -0,0 +1,80 @@
+//===================================================
+#include "ParamRegistry.h"
+#include "Identifiers.h"
+
+ParamRegistry::ParamRegistry(apvts& tree) {
+  auto resolve = [&](int idx, const juce::String& id) {
+    values[(size_t)idx] = tree.getRawParameterValue(id);
+    jassert(values[(size_t)idx] != nullptr);
+  };
+  resolve(ParamIdx::velocityTracking, ID::velocityTracking.toString());
+  resolve(ParamIdx::filterEnvDelay, ID::filterEnvDelay.toString());
+  resolve(ParamIdx::filterEnvAttack, ID::filterEnvAttack.toString());
+  resolve(ParamIdx::filterEnvHold, ID::filterEnvHold.toString());
+  resolve(ParamIdx::filterEnvDecay, ID::filterEnvDecay.toString());
+  resolve(ParamIdx::filterEnvSustain, ID::filterEnvSustain.toString());
+  resolve(ParamIdx::filterEnvRelease, ID::filterEnvRelease.toString());
+  resolve(ParamIdx::filterCutoff, ID::filterCutoff.toString());
+  resolve(ParamIdx::filterResonance, ID::filterResonance.toString());
+  resolve(ParamIdx::filterWetDry, ID::filterWetDry.toString());
+  resolve(ParamIdx::filterEnvDepth, ID::filterEnvDepth.toString());
+  resolve(ParamIdx::filterType, ID::filterType.toString());
+  for (int i = 0; i < NUM_LFOS; ++i) {
+    auto iStr = juce::String(i);
+    resolve(ParamIdx::lfo(i, ParamIdx::lfoRate), ID::lfoRate + iStr);
+    resolve(ParamIdx::lfo(i, ParamIdx::lfoDepth), ID::lfoDepth + iStr);
+    resolve(ParamIdx::lfo(i, ParamIdx::lfoWave), ID::lfoWave + iStr);
+    resolve(ParamIdx::lfo(i, ParamIdx::lfoTarget), ID::lfoTarget + iStr);
+    resolve(ParamIdx::lfo(i, ParamIdx::lfoGlobal), ID::lfoGlobal + iStr);
+  }
+  for (int i = 0; i < NUM_OPERATORS; ++i) {
+    auto iStr = juce::String(i);
+    resolve(ParamIdx::op(i, ParamIdx::opRatio), ID::operatorRatio + iStr);
+    resolve(ParamIdx::op(i, ParamIdx::opLevel), ID::operatorLevel + iStr);
+    resolve(ParamIdx::op(i, ParamIdx::opModIndex),
+            ID::operatorModIndex + iStr);
+    resolve(ParamIdx::op(i, ParamIdx::opPan), ID::operatorPan + iStr);
+    resolve(ParamIdx::op(i, ParamIdx::opAudible), ID::operatorAudible + iStr);
+    resolve(ParamIdx::op(i, ParamIdx::opWave), ID::operatorWaveShape + iStr);
+    resolve(ParamIdx::op(i, ParamIdx::envDelay), ID::envDelay + iStr);
+    resolve(ParamIdx::op(i, ParamIdx::envAttack), ID::envAttack + iStr);
+    resolve(ParamIdx::op(i, ParamIdx::envHold), ID::envHold + iStr);
+    resolve(ParamIdx::op(i, ParamIdx::envDecay), ID::envDecay + iStr);
+    resolve(ParamIdx::op(i, ParamIdx::envSustain), ID::envSustain + iStr);
+    resolve(ParamIdx::op(i, ParamIdx::envRelease), ID::envRelease + iStr);
+    for (int n = 0; n < NUM_OPERATORS; ++n) {
+      resolve(ParamIdx::routing(i, n), iStr + "to" + juce::String(n) + "Param");
+    }
+  }
+  for (int i = 0; i < NUM_MOD_SLOTS; ++i) {
+    auto iStr = juce::String(i);
+    resolve(ParamIdx::modSlot(i, ParamIdx::modSource), ID::modSource + iStr);
+    resolve(ParamIdx::modSlot(i, ParamIdx::modDest), ID::modDest + iStr);
+    resolve(ParamIdx::modSlot(i, ParamIdx::modDepth), ID::modDepth + iStr);
+  }
+}
+//===================================================
+ParamSnapshot::ParamSnapshot() {
+  // NaN never compares equal, so the first poll marks everything dirty
+  values.fill(std::numeric_limits<float>::quiet_NaN());
+}
+
+bool ParamSnapshot::poll(const ParamRegistry& registry) {
+  dirty.reset();
+  for (int i = 0; i < ParamIdx::numParams; ++i) {
+    const float value = registry.get(i);
+    if (value != values[(size_t)i]) {
+      values[(size_t)i] = value;
+      dirty.set((size_t)i);
+    }
+  }
+  return dirty.any();
+}
+
+bool ParamSnapshot::anyDirty(int first, int count) const {
+  for (int i = first; i < first + count; ++i) {
+    if (dirty[(size_t)i])
+      return true;
+  }
+  return false;
+}
@@ -9,6 +9,8 @@
 #include "PluginProcessor.h"
 #include "Identifiers.h"
 #include "PluginEditor.h"
+#include "Audio/RealtimeCheck.h"
+#include "Audio/StageProfiler.h"
 #include "juce_audio_basics/juce_audio_basics.h"
 #include "juce_core/juce_core.h"
 
@@ -26,11 +28,19 @@ HexAudioProcessor::HexAudioProcessor()
               ),
       // #endif
       tree(this),
-      synth(&tree.mainTree),
-      createdEditor(nullptr) {
+      synth(&tree.mainTree, &tree.params),
+      createdEditor(nullptr),
+      preparedBlockSize(512) {
 }
 
-HexAudioProcessor::~HexAudioProcessor() {}
+HexAudioProcessor::~HexAudioProcessor() {
+  // profiling builds of the standalone app leave their stage timings behind
+  if (StageProfiler::enabled && wrapperType == wrapperType_Standalone) {
+    StageProfiler::writeReport(
+        juce::File::getSpecialLocation(juce::File::userApplicationDataDirectory)
+            .getChildFile("HexStageProfile.json"));
+  }
+}
 
 //==============================================================================
 const juce::String HexAudioProcessor::getName() const {
@@ -62,7 +72,7 @@ bool HexAudioProcessor::isMidiEffect() const {
 }
 
 double HexAudioProcessor::getTailLengthSeconds() const {
-  return 0.0;
+  return synth.getTailLengthSeconds();
 }
 
 int HexAudioProcessor::getNumPrograms() {
@@ -94,9 +104,17 @@ void HexAudioProcessor::prepareToPlay(double sampleRate, int samplesPerBlock) {
   // Use this method as the place to do any pre-playback
   // initialisation that you need..
   SampleRate::set(sampleRate);
+  telemetry.prepare(sampleRate);
   synth.setSampleRate(sampleRate, samplesPerBlock);
   synth.prepareRingBuffer(samplesPerBlock);
+  // the voices' buffers need to be big enough up front so that rendering
+  // them on worker threads never allocates
+  synth.prepareVoiceBuffers(samplesPerBlock);
   // synth.prepareRingBuffer (samplesPerBlock);
+  preparedBlockSize = samplesPerBlock;
+  // room for a few hundred events, so splitting up an oversized block
+  // doesn't allocate either
+  chunkMidi.ensureSize(4096);
 }
 
 void HexAudioProcessor::releaseResources() {
@@ -133,15 +151,50 @@ bool HexAudioProcessor::isBusesLayoutSupported(
 void HexAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer,
                                      juce::MidiBuffer& midiMessages) {
   juce::ScopedNoDenormals nd;
-  masterKbdState.processNextMidiBuffer(midiMessages, 0, buffer.getNumSamples(),
-                                       true);
+  const RealtimeCheck::ScopedAudioThread rtCheck;
+  const auto startTicks = telemetry.blockStarted();
+  synth.beginAudioBlock();
+  {
+    // the keyboard state locks around its listeners
+    const RealtimeCheck::ScopedKnownViolations juceLocks;
+    masterKbdState.processNextMidiBuffer(midiMessages, 0,
+                                         buffer.getNumSamples(), true);
+  }
   buffer.clear();
-  synth.renderNextBlock(buffer, midiMessages, 0, buffer.getNumSamples());
-  synth.updateRoutingForBlock();
-  synth.updateOscillatorsForBlock();
-  synth.updateEnvelopesForBlock();
-  synth.updateFiltersForBlock();
-  synth.updateLfosForBlock();
+  const int numSamples = buffer.getNumSamples();
+  if (numSamples <= preparedBlockSize) {
+    renderSynth(buffer, midiMessages);
+  } else {
+    // the host went over the block size it promised in prepareToPlay. The
+    // synth's buffers only hold that many samples, so this gets rendered in
+    // pieces rather than growing them on the audio thread
+    for (int pos = 0; pos < numSamples; pos += preparedBlockSize) {
+      const int chunkSize = std::min(preparedBlockSize, numSamples - pos);
+      juce::AudioBuffer<float> chunk(buffer.getArrayOfWritePointers(),
+                                     buffer.getNumChannels(), pos, chunkSize);
+      chunkMidi.clear();
+      chunkMidi.addEvents(midiMessages, pos, chunkSize, -pos);
+      renderSynth(chunk, chunkMidi);
+    }
+  }
+  synth.updateParametersForBlock();
+  synth.endAudioBlock();
+  telemetry.blockFinished(startTicks, buffer.getNumSamples(),
+                          synth.getNumActiveVoices());
+}
+
+void HexAudioProcessor::renderSynth(juce::AudioBuffer<float>& buffer,
+                                    juce::MidiBuffer& midiMessages) {
+  // with nothing playing and nothing to start there's nothing to render,
+  // only the global LFOs and the parameters to keep up with
+  if (!midiMessages.isEmpty() || !synth.isIdle()) {
+    // juce::Synthesiser holds its lock through this, the voice rendering
+    // and note handling inside get checked as Hex's own again
+    const RealtimeCheck::ScopedKnownViolations juceLocks;
+    synth.renderNextBlock(buffer, midiMessages, 0, buffer.getNumSamples());
+  } else {
+    synth.advanceIdle(buffer.getNumSamples());
+  }
 }
 
 //==============================================================================
@@ -0,0 +1,116 @@
+//===================================================
+#include "Audio/RealtimeCheck.h"
+#include <juce_core/juce_core.h>
+#include <atomic>
+#include <cstdio>
+#if HEX_RT_CHECK && (defined(__linux__) || defined(__APPLE__))
+#define HEX_RT_BACKTRACE 1
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+
+namespace RealtimeCheck {
+#if HEX_RT_CHECK
+namespace {
+// the interposed malloc can get here before anything is constructed, so all
+// of this is zero-initialized static storage and the thread locals use the
+// initial-exec model, which doesn't allocate on first use
+#if defined(__GNUC__)
+#define HEX_RT_TLS __attribute__((tls_model("initial-exec")))
+#else
+#define HEX_RT_TLS
+#endif
+HEX_RT_TLS thread_local Mode mode = Mode::off;
+// set while a report gets written, whatever that does itself is fine
+HEX_RT_TLS thread_local bool reporting = false;
+
+std::atomic<uint32_t> numViolations;
+std::atomic<uint32_t> numKnownViolations;
+constexpr int maxReports = 64;
+constexpr int maxFrames = 48;
+std::atomic<uint64_t> reportedSites[maxReports];
+std::atomic<int> numReported;
+
+// true the first time a site comes up, false after that or once the table
+// is full
+bool claimSite(uint64_t site) {
+  const int known = std::min(numReported.load(), maxReports);
+  for (int i = 0; i < known; ++i) {
+    if (reportedSites[i].load() == site)
+      return false;
+  }
+  const int idx = numReported.fetch_add(1);
+  if (idx >= maxReports)
+    return false;
+  reportedSites[idx].store(site);
+  return true;
+}
+}  // namespace
+
+Mode setMode(Mode newMode) {
+  const Mode previous = mode;
+  mode = newMode;
+  return previous;
+}
+
+bool shouldReport() {
+  return mode != Mode::off && !reporting;
+}
+
+void reportViolation(const char* what) {
+  const bool known = mode == Mode::known;
+  (known ? numKnownViolations : numViolations)
+      .fetch_add(1, std::memory_order_relaxed);
+  const char* kind = known ? "known " : "";
+  reporting = true;
+#if HEX_RT_BACKTRACE
+  // the site is the whole stack, so the same call reached two different
+  // ways gets reported for both
+  void* frames[maxFrames];
+  const int numFrames = backtrace(frames, maxFrames);
+  uint64_t site = 14695981039346656037ull;
+  for (int i = 0; i < numFrames; ++i)
+    site = (site ^ (uint64_t)(uintptr_t)frames[i]) * 1099511628211ull;
+  if (claimSite(site)) {
+    fprintf(stderr, "[HEX_RT_CHECK] %s%s on the audio thread\n", kind, what);
+    backtrace_symbols_fd(frames, numFrames, STDERR_FILENO);
+  }
+#else
+  auto trace = juce::SystemStats::getStackBacktrace();
+  if (claimSite((uint64_t)trace.hashCode64())) {
+    fprintf(stderr, "[HEX_RT_CHECK] %s%s on the audio thread\n%s\n", kind,
+            what, trace.toRawUTF8());
+  }
+#endif
+  reporting = false;
+}
+
+uint32_t getNumViolations() {
+  return numViolations.load();
+}
+
+uint32_t getNumKnownViolations() {
+  return numKnownViolations.load();
+}
+
+void resetViolations() {
+  numViolations.store(0);
+  numKnownViolations.store(0);
+}
+#else
+Mode setMode(Mode) {
+  return Mode::off;
+}
+uint32_t getNumViolations() {
+  return 0;
+}
+uint32_t getNumKnownViolations() {
+  return 0;
+}
+void resetViolations() {}
+bool shouldReport() {
+  return false;
+}
+void reportViolation(const char*) {}
+#endif
+}  // namespace RealtimeCheck
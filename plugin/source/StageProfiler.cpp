@@ -0,0 +1,131 @@
+//===================================================
+#include "Audio/StageProfiler.h"
+#include "Audio/FMOperator.h"
+#include <bit>
+
+namespace StageProfiler {
+#if HEX_PROFILE_STAGES
+namespace {
+// bucket b holds passes that took less than 2^b ticks
+constexpr int numBuckets = 40;
+constexpr int numSlots = NUM_VOICES + 1;
+
+struct Histogram {
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> totalTicks;
+  std::atomic<int64_t> maxTicks;
+  std::array<std::atomic<uint64_t>, numBuckets> buckets;
+};
+
+// static storage, so everything starts at zero
+Histogram histograms[numSlots][numStages];
+
+const char* stageNames[] = {"envelopes",         "modulation",
+                            "oscillators",       "output",
+                            "filter",            "scalarVoice",
+                            "scopeTap",          "globalLfos",
+                            "paramUpdate",       "updateRouting",
+                            "updateOscillators", "updateEnvelopes",
+                            "updateFilters",     "updateLfos",
+                            "updateModMatrix"};
+static_assert(std::size(stageNames) == numStages);
+
+int slotFor(int voice) {
+  return (voice < 0 || voice >= NUM_VOICES) ? NUM_VOICES : voice;
+}
+}  // namespace
+
+void record(Stage stage, int voice, juce::int64 ticks) {
+  auto& h = histograms[slotFor(voice)][stage];
+  const auto t = (uint64_t)std::max(ticks, (juce::int64)0);
+  h.count.fetch_add(1, std::memory_order_relaxed);
+  h.totalTicks.fetch_add(t, std::memory_order_relaxed);
+  const int bucket = std::min((int)std::bit_width(t), numBuckets - 1);
+  h.buckets[(size_t)bucket].fetch_add(1, std::memory_order_relaxed);
+  auto prevMax = h.maxTicks.load(std::memory_order_relaxed);
+  while ((int64_t)t > prevMax &&
+         !h.maxTicks.compare_exchange_weak(prevMax, (int64_t)t,
+                                           std::memory_order_relaxed)) {
+  }
+}
+
+void reset() {
+  for (auto& slot : histograms) {
+    for (auto& h : slot) {
+      h.count.store(0, std::memory_order_relaxed);
+      h.totalTicks.store(0, std::memory_order_relaxed);
+      h.maxTicks.store(0, std::memory_order_relaxed);
+      for (auto& b : h.buckets)
+        b.store(0, std::memory_order_relaxed);
+    }
+  }
+}
+
+juce::var toVar() {
+  const double microsPerTick =
+      1.0e6 / (double)juce::Time::getHighResolutionTicksPerSecond();
+  juce::Array<juce::var> stages;
+  for (int s = 0; s < numStages; ++s) {
+    uint64_t count = 0;
+    uint64_t total = 0;
+    int64_t maxTicks = 0;
+    std::array<uint64_t, numBuckets> buckets = {};
+    juce::Array<juce::var> perVoice;
+    for (int v = 0; v < numSlots; ++v) {
+      const auto& h = histograms[v][s];
+      const auto voiceCount = h.count.load(std::memory_order_relaxed);
+      if (voiceCount == 0)
+        continue;
+      const auto voiceTotal = h.totalTicks.load(std::memory_order_relaxed);
+      count += voiceCount;
+      total += voiceTotal;
+      maxTicks = std::max(maxTicks, h.maxTicks.load(std::memory_order_relaxed));
+      for (int b = 0; b < numBuckets; ++b)
+        buckets[(size_t)b] +=
+            h.buckets[(size_t)b].load(std::memory_order_relaxed);
+      auto* voice = new juce::DynamicObject();
+      voice->setProperty("voice", v == NUM_VOICES ? juce::var("shared")
+                                                  : juce::var(v));
+      voice->setProperty("count", (juce::int64)voiceCount);
+      voice->setProperty("totalMicros", (double)voiceTotal * microsPerTick);
+      perVoice.add(juce::var(voice));
+    }
+    if (count == 0)
+      continue;
+    juce::Array<juce::var> histogram;
+    for (int b = 0; b < numBuckets; ++b) {
+      if (buckets[(size_t)b] == 0)
+        continue;
+      auto* bucket = new juce::DynamicObject();
+      bucket->setProperty("belowMicros",
+                          std::ldexp(1.0, b) * microsPerTick);
+      bucket->setProperty("count", (juce::int64)buckets[(size_t)b]);
+      histogram.add(juce::var(bucket));
+    }
+    auto* stage = new juce::DynamicObject();
+    stage->setProperty("stage", stageNames[s]);
+    stage->setProperty("count", (juce::int64)count);
+    stage->setProperty("totalMicros", (double)total * microsPerTick);
+    stage->setProperty("meanMicros",
+                       (double)total * microsPerTick / (double)count);
+    stage->setProperty("maxMicros", (double)maxTicks * microsPerTick);
+    stage->setProperty("histogram", histogram);
+    stage->setProperty("perVoice", perVoice);
+    stages.add(juce::var(stage));
+  }
+  return stages;
+}
+#else
+void record(Stage, int, juce::int64) {}
+void reset() {}
+juce::var toVar() {
+  return {};
+}
+#endif
+
+bool writeReport(const juce::File& file) {
+  if (!enabled)
+    return false;
+  return file.replaceWithText(juce::JSON::toString(toVar()));
+}
+}  // namespace StageProfiler
@@ -12,23 +12,41 @@
 #include "Audio/DAHDSR.h"
 #include "Identifiers.h"
 #include "Audio/LFO.h"
+#include "Audio/RealtimeCheck.h"
+#include "Audio/StageProfiler.h"
 #include "juce_core/juce_core.h"
 HexVoice::HexVoice(apvts* tree,
                    GraphParamSet* gParams,
                    RingBuffer<float>* buffer,
                    int idx,
-                   EnvelopeLUTGroup* luts)
+                   EnvelopeLUTGroup* luts,
+                   const ModulationSchedule* sched,
+                   const PatchSnapshot* patchSnapshot,
+                   const GlobalLfoBank* globalLfoBank)
     : linkedTree(tree),
       linkedParams(gParams),
       linkedBuffer(buffer),
       voiceIndex(idx),
       voiceFilter(luts, voiceIndex),
       justKilled(false),
+      activeOps(0),
+      filterLfoIdx(-1),
+      cutoffModActive(false),
+      noteVelocity(0.0f),
+      modWheel(0.0f),
+      useBlockRendering(true),
       internalBuffer(2, 512),
       sumL(0.0f),
       sumR(0.0f),
       fundamental(0.0f),
+      schedule(sched),
+      patch(patchSnapshot),
+      appliedPatchVersion(0),
+      globalLfos(globalLfoBank),
       voiceCleared(true),
+      stealPending(false),
+      pendingNote(-1),
+      pendingVelocity(0.0f),
       magnitude(0.0f),
       lastMagnitude(0.0f) {
   for (int i = 0; i < NUM_OPERATORS; ++i) {
@@ -36,28 +54,73 @@ HexVoice::HexVoice(apvts* tree,
   }
   for (int i = 0; i < NUM_LFOS; ++i) {
     lfos.add(new HexLfo(i));
+    lfoInUse[i] = false;
+    lfoSample[i] = 0.0f;
+    lfoValue[i] = 0.0f;
   }
+  std::fill_n(opLfoIdx, NUM_OPERATORS, -1);
 }
 
 void HexVoice::startNote(int midiNoteNumber,
                          float velocity,
                          juce::SynthesiserSound*,
                          int) {
-  voiceCleared = false;
-  fundamental = MathUtil::midiToET(midiNoteNumber);
   linkedParams->lastTriggeredVoice.store(voiceIndex);
   ++linkedParams->voicesInUse;
+  if (stealPending) {
+    // the synth has already called stopNote() without a tail, which started
+    // the fade
+    stealPending = false;
+    pendingNote = midiNoteNumber;
+    pendingVelocity = velocity;
+    return;
+  }
+  triggerNote(midiNoteNumber, velocity);
+
+  // debugPrinter.addMessage("Voice " + juce::String(voiceIndex) + " started");
+}
+
+void HexVoice::triggerNote(int midiNoteNumber, float velocity) {
+  // a voice that had finished has nothing left ringing in its filter
+  if (voiceCleared)
+    voiceFilter.reset();
+  voiceCleared = false;
+  noteVelocity = velocity;
+  fundamental = MathUtil::midiToET(midiNoteNumber);
   linkedParams->voiceFundamentals[voiceIndex].store((float)fundamental);
   voiceFilter.env.triggerOn(velocity);
   for (auto op : operators) {
     op->trigger(true, velocity);
   }
+}
 
-  // debugPrinter.addMessage("Voice " + juce::String(voiceIndex) + " started");
+void HexVoice::startPendingNote() {
+  if (pendingNote == -1 || anyEnvsActive())
+    return;
+  // the old note faded out to nothing, so there's nothing to keep. The
+  // filter envelope may still be finishing its own fade, but it only shapes
+  // the cutoff of what's now silence so it starts over too
+  voiceFilter.reset();
+  voiceFilter.env.reset();
+  triggerNote(pendingNote, pendingVelocity);
+  pendingNote = -1;
+}
+
+float HexVoice::getCurrentLevel() const {
+  float level = 0.0f;
+  for (auto op : operators) {
+    if (op->isAudible())
+      level = std::max(level, op->vEnv.getLastLevel());
+  }
+  return level;
 }
 
 void HexVoice::stopNote(float velocity, bool allowTailOff) {
+  // also reached from juce::Synthesiser's pedal and all notes off handling
+  const RealtimeCheck::ScopedAudioThread rtCheck;
   juce::ignoreUnused(velocity);
+  // a note still waiting on a steal never gets to start
+  pendingNote = -1;
   voiceFilter.env.triggerOff();
   for (auto op : operators) {
     op->trigger(false);
@@ -73,36 +136,85 @@ void HexVoice::stopNote(float velocity, bool allowTailOff) {
 void HexVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer,
                                int startSample,
                                int numSamples) {
+  renderToInternalBuffer(outputBuffer, startSample, numSamples);
+  finishBlock(outputBuffer, startSample, numSamples);
+}
+
+void HexVoice::renderToInternalBuffer(juce::AudioBuffer<float>& outputBuffer,
+                                      int startSample,
+                                      int numSamples) {
+  beginBlock(outputBuffer);
+  if (useBlockRendering)
+    renderBlock(startSample, numSamples);
+  else
+    renderScalar(startSample, numSamples);
+}
+
+void HexVoice::beginBlock(juce::AudioBuffer<float>& outputBuffer) {
+  applyPatch();
+  // any waveform or filter type changes take effect here, between blocks
+  for (auto op : operators)
+    op->oscillator.beginBlock();
+  for (auto lfo : lfos)
+    lfo->beginBlock();
+  voiceFilter.beginBlock();
   internalBuffer.clear();
   if (outputBuffer.getNumSamples() > internalBuffer.getNumSamples())
     internalBuffer.setSize(2, outputBuffer.getNumSamples());
-  for (int i = startSample; i < (startSample + numSamples); ++i) {
-    for (auto op : operators)
-      op->clearOffset();
-    tickModulation();
-    voiceFilter.tick();
-    sumL = 0.0f;
-    sumR = 0.0f;
-    int idx = 0;
-    for (auto op : operators) {
-      op->tick(fundamental, levelMod(idx));
-      if (op->isAudible()) {
-        sumL += op->lastLeft();
-        sumR += op->lastRight();
-      }
-      ++idx;
-    }
-    filterValue = filterMod();
-    if (filterValue > 0.0f) {
-      sumL = voiceFilter.processLeft(sumL, filterValue);
-      sumR = voiceFilter.processRight(sumR, filterValue);
-    } else {
-      sumL = voiceFilter.processLeft(sumL);
-      sumR = voiceFilter.processRight(sumR);
-    }
-    internalBuffer.setSample(0, i, sumR);
-    internalBuffer.setSample(1, i, sumL);
+}
+
+void HexVoice::applyPatch() {
+  if (patch->version == appliedPatchVersion)
+    return;
+  appliedPatchVersion = patch->version;
+  for (int o = 0; o < NUM_OPERATORS; ++o) {
+    const auto& p = patch->ops[(size_t)o];
+    auto* op = operators[o];
+    op->setRatio(p.ratio);
+    op->setModIndex(p.modIndex);
+    op->setPan(p.pan);
+    op->setLevel(p.level);
+    op->setAudible(p.audible);
+    op->setWave(p.wave);
+  }
+  for (int i = 0; i < NUM_LFOS; ++i) {
+    lfos[i]->setRate(patch->lfos[(size_t)i].rate);
+    lfos[i]->setType(patch->lfos[(size_t)i].wave);
+  }
+  const auto& f = patch->filter;
+  voiceFilter.setCutoff(f.cutoff);
+  voiceFilter.setResonance(f.resonance);
+  voiceFilter.setWetLevel(f.wetDry);
+  voiceFilter.setDepth(f.depth);
+  voiceFilter.setType(f.type);
+  // the mod matrix sets these again each sub-block for anything it routes to
+  for (auto op : operators) {
+    op->setRatioMod(0.0f);
+    op->setModIndexMod(0.0f);
+    op->setPanMod(0.0f);
   }
+  voiceFilter.setResonanceMod(0.0f);
+  resolveLfoTargets();
+}
+
+void HexVoice::resolveLfoTargets() {
+  for (int o = 0; o < NUM_OPERATORS; ++o)
+    opLfoIdx[o] = patch->lfoForTarget(o + 1);
+  filterLfoIdx = patch->lfoForTarget(NUM_OPERATORS + 1);
+  // an LFO only gets ticked if something reads it
+  for (int i = 0; i < NUM_LFOS; ++i) {
+    lfoInUse[i] = filterLfoIdx == i ||
+                  patch->modRoutes.usesSource(ModSource::lfo(i));
+  }
+  for (int o = 0; o < NUM_OPERATORS; ++o) {
+    if (opLfoIdx[o] != -1)
+      lfoInUse[opLfoIdx[o]] = true;
+  }
+}
+
+void HexVoice::finishBlock(juce::AudioBuffer<float>& outputBuffer,
+                           int startSample,
+                           int numSamples) {
   outputBuffer.addFrom(0, startSample, internalBuffer, 0, startSample,
                        numSamples);
   outputBuffer.addFrom(1, startSample, internalBuffer, 1, startSample,
@@ -115,306 +227,688 @@ void HexVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer,
         voiceFilter.env.getLastLevel());
   }
   if (linkedParams->lastTriggeredVoice == voiceIndex) {
+    const StageProfiler::ScopedTimer timer(StageProfiler::scopeTap,
+                                           voiceIndex);
     linkedBuffer->writeSamples(internalBuffer, startSample, numSamples);
   }
-  if (!anyEnvsActive()) {
+  startPendingNote();
+  // a voice still holding a stolen note mustn't go back on the free list
+  if (!anyEnvsActive() && !hasPendingNote()) {
     clearCurrentNote();
     voiceCleared = true;
   }
 }
 //=====================================================================================================================
+void HexVoice::renderScalar(int startSample, int numSamples) {
+  // the per-sample path interleaves every stage, so it's timed as a whole
+  const StageProfiler::ScopedTimer timer(StageProfiler::scalarVoice,
+                                         voiceIndex);
+  for (int i = startSample; i < (startSample + numSamples); ++i) {
+    tickLfos(i);
+    voiceFilter.tick();
+    tickModulation();
+    for (int k = 0; k < NUM_OPERATORS; ++k) {
+      applyModulation(k);
+      const int o = schedule->order[(size_t)k];
+      operators[o]->tickAtGain(fundamental, blockBufs.opGain[o][0]);
+    }
+    sumL = 0.0f;
+    sumR = 0.0f;
+    for (auto op : operators) {
+      if (op->isAudible()) {
+        sumL += op->lastLeft();
+        sumR += op->lastRight();
+      }
+    }
+    filterValue = cutoffModActive ? blockBufs.cutoffMod[0] : 0.0f;
+    voiceFilter.processSample(sumL, sumR, filterValue);
+    internalBuffer.setSample(0, i, sumR);
+    internalBuffer.setSample(1, i, sumL);
+  }
+  startPendingNote();
+}
+
+void HexVoice::renderBlock(int startSample, int numSamples) {
+  int sample = startSample;
+  const int endSample = startSample + numSamples;
+  while (sample < endSample) {
+    // once everything audible has finished the rest of the block is silent,
+    // and internalBuffer already got cleared. Unless a stolen note was
+    // waiting on exactly that
+    startPendingNote();
+    if (!anyEnvsActive())
+      return;
+    const int subBlockSize = std::min(VOICE_SUB_BLOCK, endSample - sample);
+    renderSubBlock(sample, subBlockSize);
+    sample += subBlockSize;
+  }
+}
+
+void HexVoice::renderSubBlock(int startSample, int numSamples) {
+  renderEnvelopeStage(numSamples);
+  renderModulationStage(startSample, numSamples);
+  renderOperatorStage(numSamples);
+  renderOutputStage(startSample, numSamples);
+  startPendingNote();
+}
+
+void HexVoice::tickLfos(int sample) {
+  for (int l = 0; l < NUM_LFOS; ++l) {
+    if (!lfoInUse[l])
+      continue;
+    const auto& p = patch->lfos[(size_t)l];
+    const float value =
+        p.global ? globalLfos->getValues(l)[sample] : lfos[l]->tick();
+    lfoValue[l] = value;
+    lfoSample[l] = value * p.depth;
+  }
+}
+
 void HexVoice::tickModulation() {
-  for (size_t o = 0; o < NUM_OPERATORS; ++o) {
-    for (size_t i = 0; i < NUM_OPERATORS; ++i) {
-      if (grid[o][i]) {
-        operators[(int)i]->addModFrom(*operators[(int)o]);
+  for (int o = 0; o < NUM_OPERATORS; ++o) {
+    blockBufs.opGain[o][0] =
+        MathUtil::fLerp(operators[o]->getLevel(), 1.0f, levelMod(o));
+  }
+  cutoffModActive = filterLfoIdx != -1;
+  blockBufs.cutoffMod[0] = filterMod();
+  const auto& list = patch->modRoutes;
+  for (int d = 0; d < list.numDests; ++d) {
+    float value = 0.0f;
+    for (int r = list.destStart[(size_t)d]; r < list.destStart[(size_t)d + 1];
+         ++r) {
+      const auto& route = list.routes[(size_t)r];
+      value += modSourceSample(route.source) * route.depth;
+    }
+    applyModDest(list.dests[(size_t)d], &value, 1);
+  }
+}
+
+float HexVoice::modSourceSample(int source) const {
+  if (source < ModSource::opEnv(0))
+    return lfoValue[source - ModSource::lfo(0)];
+  // the operators' envelopes advance as the operators tick, which comes
+  // after this, so they read one sample behind the block path
+  if (source < ModSource::filterEnv)
+    return operators[source - ModSource::opEnv(0)]->vEnv.getLastLevel();
+  if (source == ModSource::filterEnv)
+    return voiceFilter.env.getLastLevel();
+  return modSourceValue(source);
+}
+
+void HexVoice::renderModulationStage(int startSample, int numSamples) {
+  const StageProfiler::ScopedTimer timer(StageProfiler::modulation, voiceIndex);
+  // render each LFO that something reads once for the sub-block, global ones
+  // come from the synth's shared values
+  for (int l = 0; l < NUM_LFOS; ++l) {
+    if (!lfoInUse[l])
+      continue;
+    auto* dest = blockBufs.lfo[l];
+    if (patch->lfos[(size_t)l].global) {
+      juce::FloatVectorOperations::copy(
+          dest, globalLfos->getValues(l) + startSample, numSamples);
+    } else {
+      auto* lfo = lfos[l];
+      for (int i = 0; i < numSamples; ++i)
+        dest[i] = lfo->tick();
+    }
+  }
+  // then fold the ones with a target into the per-operator level gains and
+  // the filter cutoff
+  for (int o = 0; o < NUM_OPERATORS; ++o) {
+    auto* gain = blockBufs.opGain[o];
+    const float level = operators[o]->getLevel();
+    if (opLfoIdx[o] == -1) {
+      std::fill_n(gain, numSamples, level);
+      continue;
+    }
+    const float* mod = blockBufs.lfo[opLfoIdx[o]];
+    const float depth = patch->lfos[(size_t)opLfoIdx[o]].depth;
+    for (int i = 0; i < numSamples; ++i)
+      gain[i] = MathUtil::fLerp(level, 1.0f, mod[i] * depth);
+  }
+  cutoffModActive = filterLfoIdx != -1;
+  if (cutoffModActive) {
+    juce::FloatVectorOperations::multiply(
+        blockBufs.cutoffMod, blockBufs.lfo[filterLfoIdx],
+        patch->lfos[(size_t)filterLfoIdx].depth, numSamples);
+    // the LFO has only ever pushed the cutoff up, only mod matrix routes
+    // can pull it down
+    juce::FloatVectorOperations::max(blockBufs.cutoffMod, blockBufs.cutoffMod,
+                                     0.0f, numSamples);
+  }
+  if (patch->modRoutes.numRoutes > 0)
+    renderModMatrix(numSamples);
+}
+
+void HexVoice::renderModMatrix(int numSamples) {
+  const auto& list = patch->modRoutes;
+  for (int d = 0; d < list.numDests; ++d) {
+    const int dest = list.dests[(size_t)d];
+    // block rate destinations only read the first sample
+    const int length = ModDest::isBlockRate(dest) ? 1 : numSamples;
+    float* values = blockBufs.modDest[d];
+    juce::FloatVectorOperations::clear(values, length);
+    for (int r = list.destStart[(size_t)d]; r < list.destStart[(size_t)d + 1];
+         ++r) {
+      const auto& route = list.routes[(size_t)r];
+      if (auto* src = modSourceBuffer(route.source)) {
+        juce::FloatVectorOperations::addWithMultiply(values, src, route.depth,
+                                                     length);
+      } else {
+        juce::FloatVectorOperations::add(
+            values, modSourceValue(route.source) * route.depth, length);
       }
     }
+    applyModDest(dest, values, length);
   }
 }
+
+void HexVoice::applyModDest(int dest, const float* values, int numSamples) {
+  if (dest == ModDest::filterCutoff) {
+    if (cutoffModActive)
+      juce::FloatVectorOperations::add(blockBufs.cutoffMod, values,
+                                       numSamples);
+    else
+      juce::FloatVectorOperations::copy(blockBufs.cutoffMod, values,
+                                        numSamples);
+    cutoffModActive = true;
+    return;
+  }
+  if (dest == ModDest::filterResonance) {
+    voiceFilter.setResonanceMod(values[0]);
+    return;
+  }
+  const int o = ModDest::opIndex(dest);
+  auto* op = operators[o];
+  switch (ModDest::opParam(dest)) {
+    case ModDest::opRatio:
+      op->setRatioMod(values[0]);
+      return;
+    case ModDest::opModIndex:
+      op->setModIndexMod(values[0]);
+      return;
+    case ModDest::opPan:
+      op->setPanMod(values[0]);
+      return;
+    case ModDest::opLevel: {
+      auto* gain = blockBufs.opGain[o];
+      juce::FloatVectorOperations::add(gain, values, numSamples);
+      juce::FloatVectorOperations::clip(gain, gain, 0.0f, 1.0f, numSamples);
+      return;
+    }
+  }
+}
+
+const float* HexVoice::modSourceBuffer(int source) const {
+  if (source < ModSource::opEnv(0))
+    return blockBufs.lfo[source - ModSource::lfo(0)];
+  if (source < ModSource::filterEnv)
+    return blockBufs.opEnv[source - ModSource::opEnv(0)];
+  if (source == ModSource::filterEnv)
+    return blockBufs.filterEnv;
+  return nullptr;
+}
+
+void HexVoice::renderEnvelopeStage(int numSamples) {
+  const StageProfiler::ScopedTimer timer(StageProfiler::envelopes, voiceIndex);
+  activeOps = 0;
+  for (int o = 0; o < NUM_OPERATORS; ++o) {
+    auto* op = operators[o];
+    // notes only start between sub-blocks, so a silent envelope stays
+    // silent for all of this one
+    if (op->vEnv.isSilent()) {
+      std::fill_n(blockBufs.opEnv[o], numSamples, 0.0f);
+    } else {
+      op->vEnv.renderLevels(blockBufs.opEnv[o], numSamples);
+      if ((patch->liveOps >> o) & 1)
+        activeOps |= 1u << o;
+    }
+    // skipped operators read as silent to anything they modulate
+    if (!((activeOps >> o) & 1))
+      op->setLastMono(0.0f);
+  }
+  voiceFilter.env.renderLevels(blockBufs.filterEnv, numSamples);
+}
+
+void HexVoice::renderOperatorStage(int numSamples) {
+  const StageProfiler::ScopedTimer timer(StageProfiler::oscillators,
+                                         voiceIndex);
+  if (schedule->numEdges == 0) {
+    // no modulation at all, every operator can run a whole sub-block alone
+    for (int o = 0; o < NUM_OPERATORS; ++o) {
+      if (!((activeOps >> o) & 1))
+        continue;
+      operators[o]->renderUnmodulated(blockBufs.opOut[o], fundamental,
+                                      blockBufs.opGain[o],
+                                      blockBufs.opEnv[o], numSamples);
+    }
+    return;
+  }
+  int active[NUM_OPERATORS];
+  int numActive = 0;
+  for (int k = 0; k < NUM_OPERATORS; ++k) {
+    if ((activeOps >> schedule->order[(size_t)k]) & 1)
+      active[numActive++] = k;
+  }
+  // Operators feed each other within the sample (and through feedback edges
+  // across samples), so this stage has to step through the operators together
+  // one sample at a time
+  for (int i = 0; i < numSamples; ++i) {
+    for (int n = 0; n < numActive; ++n) {
+      const int k = active[n];
+      applyModulation(k);
+      const int o = schedule->order[(size_t)k];
+      blockBufs.opOut[o][i] = operators[o]->tickWithGains(
+          fundamental, blockBufs.opGain[o][i], blockBufs.opEnv[o][i]);
+    }
+  }
+}
+
+void HexVoice::renderOutputStage(int startSample, int numSamples) {
+  renderPanStage(numSamples);
+  {
+    const StageProfiler::ScopedTimer timer(StageProfiler::filter, voiceIndex);
+    voiceFilter.processBlock(blockBufs.left, blockBufs.right,
+                             blockBufs.filterEnv, getFilterMod(), numSamples);
+  }
+  writeOutputStage(startSample, numSamples);
+}
+
+void HexVoice::renderPanStage(int numSamples) {
+  const StageProfiler::ScopedTimer timer(StageProfiler::output, voiceIndex);
+  // pan and sum the audible operators
+  std::fill_n(blockBufs.left, numSamples, 0.0f);
+  std::fill_n(blockBufs.right, numSamples, 0.0f);
+  for (int o = 0; o < NUM_OPERATORS; ++o) {
+    if (!operators[o]->isAudible() || !((activeOps >> o) & 1))
+      continue;
+    const float pan = operators[o]->getPan();
+    const float* out = blockBufs.opOut[o];
+    for (int i = 0; i < numSamples; ++i) {
+      blockBufs.left[i] += out[i] * pan;
+      blockBufs.right[i] += out[i] * (1.0f - pan);
+    }
+  }
+}
+
+void HexVoice::writeOutputStage(int startSample, int numSamples) {
+  const StageProfiler::ScopedTimer timer(StageProfiler::output, voiceIndex);
+  internalBuffer.copyFrom(0, startSample, blockBufs.right, numSamples);
+  internalBuffer.copyFrom(1, startSample, blockBufs.left, numSamples);
+}
 //=====================================================================================================================
-HexSynth::HexSynth(apvts* tree)
+HexSynth::HexSynth(apvts* tree, const ParamRegistry* registry)
     : linkedTree(tree),
+      paramRegistry(registry),
       graphBuffer(2, 256 * 10),
+      grid(),
+      patchChanged(false),
+      blockRendering(true),
+      pooledOutput(nullptr),
+      pooledStart(0),
+      pooledNumSamples(0),
+      lastBlockSize(512),
+      globalLfoPatchVersion(0),
       magnitude(0.0f),
       lastMagnitude(0.0f),
       numJumps(0) {
   for (int i = 0; i < NUM_VOICES; ++i) {
     addVoice(
-        new HexVoice(linkedTree, &graphParams, &graphBuffer, i, &envelopeData));
+        new HexVoice(linkedTree, &graphParams, &graphBuffer, i, &envelopeData,
+                     &schedule, &patch, &globalLfos));
     auto* voice = dynamic_cast<HexVoice*>(voices.getLast());
     hexVoices.push_back(voice);
   }
   addSound(new HexSound);
-  setNoteStealingEnabled(false);
-}
-//
-// juce::SynthesiserVoice* HexSynth::findFreeVoice(
-//     juce::SynthesiserSound* soundToPlay,
-//     int midiChannel,
-//     int midiNoteNum,
-//     bool stealIfNoneAvailible) const {
-//   auto idx = 0;
-//   for (auto v : hexVoices) {
-//     if (v->isVoiceCleared()) {
-//       return v;
-//     }
-//     ++idx;
-//   }
-//   return nullptr;
-// }
-//
-// void HexSynth::noteOn(int midiChannel, int midiNoteNumber, float velocity) {
-//   const juce::ScopedLock sl(lock);
-//   for (auto* sound : sounds) {
-//     if (sound->appliesToNote(midiNoteNumber) &&
-//         sound->appliesToChannel(midiChannel)) {
-//       //! if a voice is already playing this note, stop it
-//       for (auto* voice : hexVoices) {
-//         if (voice->getCurrentlyPlayingNote() == midiNoteNumber &&
-//             voice->isPlayingChannel(midiChannel)) {
-//           stopVoice(voice, 1.0f, true);
-//           voice->justKilled = true;
-//         } else
-//           voice->justKilled = false;
-//       }
-//       auto* freeVoice = findFreeVoice(sound, midiChannel, midiNoteNumber,
-//       true); if (freeVoice != nullptr) {
-//         startVoice(freeVoice, sound, midiChannel, midiNoteNumber, velocity);
-//       }
-//     }
-//   }
-// }
-// void HexSynth::noteOff(int midiChannel,
-//                        int midiNoteNumber,
-//                        float velocity,
-//                        bool allowTailOff) {
-//   const juce::ScopedLock sl(lock);
-//   for (auto* voice : voices) {
-//     if (voice->getCurrentlyPlayingNote() == midiNoteNumber &&
-//         voice->isPlayingChannel(midiChannel)) {
-//       if (auto sound = voice->getCurrentlyPlayingSound()) {
-//         if (sound->appliesToNote(midiNoteNumber) &&
-//             sound->appliesToChannel(midiChannel)) {
-//           voice->setKeyDown(false);
-//           if (!(voice->isSustainPedalDown() ||
-//           voice->isSostenutoPedalDown()))
-//             stopVoice(voice, velocity, allowTailOff);
-//         }
-//       }
-//     }
-//   }
-// }
-//
-void HexSynth::renderVoices(juce::AudioBuffer<float>& buffer,
-                            int startSample,
-                            int numSamples) {
-  const juce::ScopedLock sl(lock);
-  for (auto v : hexVoices) {
-    if (!v->isVoiceCleared())
-      v->renderNextBlock(buffer, startSample, numSamples);
-  }
 }
 
-//=====================================================================================================================
-void HexSynth::setRate(int idx, float value) {
+void HexSynth::noteOn(int midiChannel, int midiNoteNumber, float velocity) {
   const juce::ScopedLock sl(lock);
-  for (auto v : hexVoices) {
-    v->lfos[idx]->setRate(value);
-  }
+  const RealtimeCheck::ScopedAudioThread rtCheck;
+  auto* sound = getSound(0).get();
+  if (sound == nullptr || !sound->appliesToNote(midiNoteNumber) ||
+      !sound->appliesToChannel(midiChannel))
+    return;
+  // the same note again releases the voice that was playing it
+  const int held = allocator.voiceFor(midiChannel, midiNoteNumber);
+  if (held != -1) {
+    stopVoice(hexVoices[(size_t)held], 1.0f, true);
+    allocator.unmapNote(held);
+  }
+  int idx = allocator.acquire();
+  if (idx == -1) {
+    idx = findVoiceToSteal();
+    hexVoices[(size_t)idx]->prepareToSteal();
+  }
+  allocator.mapNote(idx, midiChannel, midiNoteNumber);
+  // startVoice stops whatever the voice was playing without a tail, which
+  // is the quick fade the steal waits on
+  startVoice(hexVoices[(size_t)idx], sound, midiChannel, midiNoteNumber,
+             velocity);
 }
-void HexSynth::setDepth(int idx, float value) {
+
+void HexSynth::noteOff(int midiChannel,
+                       int midiNoteNumber,
+                       float velocity,
+                       bool allowTailOff) {
   const juce::ScopedLock sl(lock);
-  for (auto v : hexVoices) {
-    v->lfoDepths[idx] = value;
+  const RealtimeCheck::ScopedAudioThread rtCheck;
+  const int idx = allocator.voiceFor(midiChannel, midiNoteNumber);
+  if (idx == -1)
+    return;
+  auto* voice = hexVoices[(size_t)idx];
+  voice->setKeyDown(false);
+  // held by a pedal, handleSustainPedal() stops it when that comes up
+  if (voice->isSustainPedalDown() || voice->isSostenutoPedalDown())
+    return;
+  stopVoice(voice, velocity, allowTailOff);
+  allocator.unmapNote(idx);
+}
+
+double HexSynth::getTailLengthSeconds() const {
+  float longest = 0.0f;
+  for (auto& env : envelopeData.operatorEnv)
+    longest = std::max(longest, env.getRelease());
+  // the filter can still be moving on a release that outlasts the operators'
+  longest = std::max(longest, envelopeData.filterEnv.getRelease());
+  return (double)longest / 1000.0;
+}
+
+int HexSynth::findVoiceToSteal() const {
+  int best = 0;
+  float bestScore = std::numeric_limits<float>::max();
+  for (int i = 0; i < NUM_VOICES; ++i) {
+    auto* v = hexVoices[(size_t)i];
+    // envelope levels are at most 1, so this puts every held note behind
+    // every released one. A voice already waiting on a steal still reports
+    // the level of the note fading out of it and would get picked again by
+    // the next note of a chord, so those go last, the softest waiting note
+    // first
+    const float score =
+        v->hasPendingNote()
+            ? 4.0f + v->getPendingVelocity()
+            : v->getCurrentLevel() + (v->isKeyDown() ? 2.0f : 0.0f);
+    if (score < bestScore) {
+      bestScore = score;
+      best = i;
+    }
   }
+  return best;
 }
-void HexSynth::setTarget(int idx, float value) {
-  const juce::ScopedLock sl(lock);
-  for (auto v : hexVoices) {
-    v->lfoTargets[(size_t)idx] = (int)value;
+
+void HexSynth::releaseFinishedVoices() {
+  for (int i = 0; i < NUM_VOICES; ++i) {
+    if (hexVoices[(size_t)i]->isVoiceCleared() && !allocator.isFree(i))
+      allocator.release(i);
   }
 }
-void HexSynth::setLfoWave(int idx, float value) {
-  for (auto v : hexVoices)
-    v->lfos[idx]->setType((int)value);
+
+void HexSynth::renderVoices(juce::AudioBuffer<float>& buffer,
+                            int startSample,
+                            int numSamples) {
+  // juce::Synthesiser::processNextBlock already holds the lock in here
+  const RealtimeCheck::ScopedAudioThread rtCheck;
+  renderGlobalLfos(startSample, numSamples);
+  renderActiveVoices(buffer, startSample, numSamples);
+  releaseFinishedVoices();
 }
-//==============================================================================================
 
-void HexSynth::setCutoff(float value) {
-  const juce::ScopedLock sl(lock);
-  for (auto voice : hexVoices) {
-    voice->voiceFilter.setCutoff(value);
+void HexSynth::renderActiveVoices(juce::AudioBuffer<float>& buffer,
+                                  int startSample,
+                                  int numSamples) {
+  if (renderPool != nullptr) {
+    int numActive = 0;
+    for (auto v : hexVoices) {
+      if (!v->isVoiceCleared())
+        pooledVoices[numActive++] = v;
+    }
+    pooledOutput = &buffer;
+    pooledStart = startSample;
+    pooledNumSamples = numSamples;
+    renderPool->run(numActive, &HexSynth::renderPooledVoice, this);
+    // summing on this thread in voice order keeps the output deterministic
+    for (int i = 0; i < numActive; ++i)
+      pooledVoices[i]->finishBlock(buffer, startSample, numSamples);
+    return;
+  }
+  if (!blockRendering || !voiceBank.isEnabled()) {
+    for (auto v : hexVoices) {
+      if (!v->isVoiceCleared())
+        v->renderNextBlock(buffer, startSample, numSamples);
+    }
+    return;
   }
-}
-void HexSynth::setResonance(float value) {
-  const juce::ScopedLock sl(lock);
-  for (auto voice : hexVoices) {
-    voice->voiceFilter.setResonance(value);
+  HexVoice* activeVoices[NUM_VOICES];
+  int numActive = 0;
+  for (auto v : hexVoices) {
+    if (!v->isVoiceCleared())
+      activeVoices[numActive++] = v;
   }
-}
-void HexSynth::setWetDry(float value) {
-  const juce::ScopedLock sl(lock);
-  for (auto voice : hexVoices) {
-    voice->voiceFilter.setWetLevel(value);
+  for (int i = 0; i < numActive; ++i)
+    activeVoices[i]->beginBlock(buffer);
+  const int width = voiceBank.getLaneWidth();
+  for (int i = 0; i < numActive; i += width) {
+    voiceBank.renderGroup(&activeVoices[i], std::min(width, numActive - i),
+                          startSample, numSamples);
   }
+  for (int i = 0; i < numActive; ++i)
+    activeVoices[i]->finishBlock(buffer, startSample, numSamples);
 }
-void HexSynth::setDepth(float value) {
-  const juce::ScopedLock sl(lock);
-  for (auto voice : hexVoices) {
-    voice->voiceFilter.setDepth(value);
-  }
+
+void HexSynth::handleController(int midiChannel,
+                                int controllerNumber,
+                                int controllerValue) {
+  if (controllerNumber == 1) {
+    const RealtimeCheck::ScopedAudioThread rtCheck;
+    const float value = (float)controllerValue / 127.0f;
+    for (auto v : hexVoices)
+      v->setModWheel(value);
+  }
+  juce::Synthesiser::handleController(midiChannel, controllerNumber,
+                                      controllerValue);
 }
-void HexSynth::setFilterType(float value) {
-  auto tVal = (int)value;
-  for (auto voice : hexVoices) {
-    voice->voiceFilter.setType(tVal);
+
+void HexSynth::renderGlobalLfos(int startSample, int numSamples) {
+  const StageProfiler::ScopedTimer timer(StageProfiler::globalLfos,
+                                         StageProfiler::shared);
+  const bool patchChangedSinceLast = globalLfoPatchVersion != patch.version;
+  globalLfoPatchVersion = patch.version;
+  for (int i = 0; i < NUM_LFOS; ++i) {
+    const auto& p = patch.lfos[(size_t)i];
+    if (!p.global ||
+        (p.target == 0 && !patch.modRoutes.usesSource(ModSource::lfo(i))))
+      continue;
+    auto& lfo = globalLfos.getLfo(i);
+    if (patchChangedSinceLast) {
+      lfo.setRate(p.rate);
+      lfo.setType(p.wave);
+    }
+    lfo.beginBlock();
+    globalLfos.render(i, startSample, numSamples);
   }
 }
-//============================================================
-void HexSynth::setAudible(int idx, bool value) {
+
+void HexSynth::setBlockRendering(bool shouldUseBlocks) {
   const juce::ScopedLock sl(lock);
-  for (auto voice : hexVoices) {
-    voice->setAudible(idx, value);
-  }
+  blockRendering = shouldUseBlocks;
+  for (auto v : hexVoices)
+    v->setBlockRendering(shouldUseBlocks);
 }
-void HexSynth::setModIndex(int idx, float value) {
+
+void HexSynth::setOscInterpolation(OscInterpolation mode) {
   const juce::ScopedLock sl(lock);
-  for (auto voice : hexVoices) {
-    voice->setModIndex(idx, value);
+  for (auto v : hexVoices) {
+    for (auto op : v->operators)
+      op->oscillator.setInterpolation(mode);
   }
 }
-void HexSynth::setRatio(int idx, float value) {
+
+void HexSynth::setVoiceBankEnabled(bool shouldBeEnabled) {
   const juce::ScopedLock sl(lock);
-  for (auto voice : hexVoices) {
-    voice->setRatio(idx, value);
-  }
+  voiceBank.setEnabled(shouldBeEnabled);
 }
-void HexSynth::setPan(int idx, float value) {
-  const juce::ScopedLock sl(lock);
-  for (auto voice : hexVoices) {
-    voice->setPan(idx, value);
+
+void HexSynth::setThreadedRendering(bool shouldBeThreaded, int numWorkers) {
+  std::unique_ptr<VoiceRenderPool> newPool;
+  if (shouldBeThreaded) {
+    if (numWorkers < 0)
+      numWorkers = juce::SystemStats::getNumCpus() - 1;
+    numWorkers = std::min(numWorkers, VoiceRenderPool::maxWorkers);
+    if (numWorkers > 0) {
+      newPool = std::make_unique<VoiceRenderPool>(numWorkers, lastBlockSize,
+                                                  getSampleRate());
+    }
+  }
+  {
+    const juce::ScopedLock sl(lock);
+    std::swap(renderPool, newPool);
   }
+  // the old pool (if any) gets shut down out here, away from the lock
 }
 
-void HexSynth::setLevel(int idx, float value) {
-  const juce::ScopedLock sl(lock);
-  for (auto voice : hexVoices) {
-    voice->setLevel(idx, value);
-  }
+void HexSynth::renderPooledVoice(void* context, int jobIndex) {
+  const RealtimeCheck::ScopedAudioThread rtCheck;
+  auto* synth = static_cast<HexSynth*>(context);
+  synth->pooledVoices[jobIndex]->renderToInternalBuffer(
+      *synth->pooledOutput, synth->pooledStart, synth->pooledNumSamples);
 }
 
-void HexSynth::setWave(int idx, float value) {
-  const juce::ScopedLock sl(lock);
-  for (auto voice : hexVoices) {
-    voice->setWave(idx, value);
+//===========================================================================
+void HexSynth::updateParametersForBlock() {
+  const StageProfiler::ScopedTimer timer(StageProfiler::paramUpdate,
+                                         StageProfiler::shared);
+  if (!paramValues.poll(*paramRegistry))
+    return;
+  updateRoutingForBlock();
+  updateOscillatorsForBlock();
+  updateEnvelopesForBlock();
+  updateFiltersForBlock();
+  updateLfosForBlock();
+  updateModMatrixForBlock();
+  // depends on both the routing and the audible flags
+  const uint32_t liveOps = schedule.liveOperators(patch.audibleOps());
+  if (liveOps != patch.liveOps) {
+    patch.liveOps = liveOps;
+    patchChanged = true;
+  }
+  // the voices pick this up at the start of their next block
+  if (patchChanged) {
+    ++patch.version;
+    patchChanged = false;
   }
 }
-//===========================================================================
+
 void HexSynth::updateRoutingForBlock() {
+  const StageProfiler::ScopedTimer timer(StageProfiler::updateRouting,
+                                         StageProfiler::shared);
+  RoutingGrid newGrid;
   for (size_t o = 0; o < NUM_OPERATORS; ++o) {
-    auto oStr = juce::String(o);
     for (size_t i = 0; i < NUM_OPERATORS; ++i) {
-      auto iStr = juce::String(i);
-      auto str = oStr + "to" + iStr + "Param";
-      if (*linkedTree->getRawParameterValue(str) > 0.0f)
-        grid[o][i] = true;
-      else
-        grid[o][i] = false;
+      newGrid[o][i] = paramValues[ParamIdx::routing((int)o, (int)i)] > 0.0f;
     }
   }
-  const juce::ScopedLock sl(lock);
-  for (auto voice : hexVoices) {
-    voice->updateGrid(grid);
-  }
+  if (newGrid == grid)
+    return;
+  grid = newGrid;
+  // the voices only read the schedule while rendering, which happens on
+  // this thread before this gets called, so there's nothing to lock against
+  schedule = ModulationSchedule::compile(grid);
 }
 
 void HexSynth::updateEnvelopesForBlock() {
-  const float vTracking =
-      linkedTree->getRawParameterValue(ID::velocityTracking.toString())->load();
-  VelTracking::setTrackingAmount(vTracking);
-  for (size_t i = 0; i < NUM_OPERATORS; ++i) {
-    auto iStr = juce::String(i);
-    auto delayId = ID::envDelay + iStr;
-    auto attackId = ID::envAttack + iStr;
-    auto holdId = ID::envHold + iStr;
-    auto decayId = ID::envDecay + iStr;
-    auto sustainId = ID::envSustain + iStr;
-    auto releaseId = ID::envRelease + iStr;
-    const float delay = *linkedTree->getRawParameterValue(delayId);
-    const float attack = *linkedTree->getRawParameterValue(attackId);
-    const float hold = *linkedTree->getRawParameterValue(holdId);
-    const float decay = *linkedTree->getRawParameterValue(decayId);
-    const float sustain = *linkedTree->getRawParameterValue(sustainId);
-    const float release = *linkedTree->getRawParameterValue(releaseId);
-    envelopeData.operatorEnv[i].setDelay(delay);
-    envelopeData.operatorEnv[i].setAttack(attack);
-    envelopeData.operatorEnv[i].setHold(hold);
-    envelopeData.operatorEnv[i].setDecay(decay);
-    envelopeData.operatorEnv[i].setSustain(sustain);
-    envelopeData.operatorEnv[i].setRelease(release);
+  const StageProfiler::ScopedTimer timer(StageProfiler::updateEnvelopes,
+                                         StageProfiler::shared);
+  if (paramValues.isDirty(ParamIdx::velocityTracking))
+    VelTracking::setTrackingAmount(paramValues[ParamIdx::velocityTracking]);
+  for (int i = 0; i < NUM_OPERATORS; ++i) {
+    auto& env = envelopeData.operatorEnv[i];
+    const auto param = [&](int p) { return ParamIdx::op(i, p); };
+    if (!paramValues.anyDirty(param(ParamIdx::envDelay), 6))
+      continue;
+    env.setDelay(paramValues[param(ParamIdx::envDelay)]);
+    env.setAttack(paramValues[param(ParamIdx::envAttack)]);
+    env.setHold(paramValues[param(ParamIdx::envHold)]);
+    env.setDecay(paramValues[param(ParamIdx::envDecay)]);
+    env.setSustain(paramValues[param(ParamIdx::envSustain)]);
+    env.setRelease(paramValues[param(ParamIdx::envRelease)]);
   }
 }
+
 void HexSynth::updateOscillatorsForBlock() {
+  const StageProfiler::ScopedTimer timer(StageProfiler::updateOscillators,
+                                         StageProfiler::shared);
   for (int i = 0; i < NUM_OPERATORS; ++i) {
-    auto iStr = juce::String(i);
-    auto ratioId = ID::operatorRatio + iStr;
-    auto indexId = ID::operatorModIndex + iStr;
-    auto outputId = ID::operatorAudible + iStr;
-    auto panId = ID::operatorPan + iStr;
-    auto waveId = ID::operatorWaveShape + iStr;
-    auto levelId = ID::operatorLevel + iStr;
-    float ratio = *linkedTree->getRawParameterValue(ratioId);
-    float modIndex = *linkedTree->getRawParameterValue(indexId);
-    bool audible = (*linkedTree->getRawParameterValue(outputId) > 0.0f);
-    float pan = *linkedTree->getRawParameterValue(panId);
-    float level = *linkedTree->getRawParameterValue(levelId);
-    float wave = *linkedTree->getRawParameterValue(waveId);
-    setRatio(i, ratio);
-    setModIndex(i, modIndex);
-    setAudible(i, audible);
-    setPan(i, pan);
-    setLevel(i, level);
-    setWave(i, wave);
+    if (!paramValues.anyDirty(ParamIdx::op(i, 0), ParamIdx::envDelay))
+      continue;
+    const auto param = [&](int p) { return paramValues[ParamIdx::op(i, p)]; };
+    auto& op = patch.ops[(size_t)i];
+    op.ratio = param(ParamIdx::opRatio);
+    op.modIndex = param(ParamIdx::opModIndex);
+    op.audible = param(ParamIdx::opAudible) > 0.0f;
+    op.pan = param(ParamIdx::opPan);
+    op.level = param(ParamIdx::opLevel);
+    op.wave = (int)param(ParamIdx::opWave);
+    patchChanged = true;
   }
 }
 
 void HexSynth::updateFiltersForBlock() {
-  float delay = *linkedTree->getRawParameterValue(ID::filterEnvDelay);
-  float attack = *linkedTree->getRawParameterValue(ID::filterEnvAttack);
-  float hold = *linkedTree->getRawParameterValue(ID::filterEnvHold);
-  float decay = *linkedTree->getRawParameterValue(ID::filterEnvDecay);
-  float sustain = *linkedTree->getRawParameterValue(ID::filterEnvSustain);
-  float release = *linkedTree->getRawParameterValue(ID::filterEnvRelease);
-  envelopeData.filterEnv.setDelay(delay);
-  envelopeData.filterEnv.setAttack(attack);
-  envelopeData.filterEnv.setHold(hold);
-  envelopeData.filterEnv.setDecay(decay);
-  envelopeData.filterEnv.setSustain(sustain);
-  envelopeData.filterEnv.setRelease(release);
-
-  float cutoff = *linkedTree->getRawParameterValue(ID::filterCutoff);
-  float resonance = *linkedTree->getRawParameterValue(ID::filterResonance);
-  float wet = *linkedTree->getRawParameterValue(ID::filterWetDry);
-  float depth = *linkedTree->getRawParameterValue(ID::filterEnvDepth);
-  float type = *linkedTree->getRawParameterValue(ID::filterType);
-  setCutoff(cutoff);
-  setResonance(resonance);
-  setWetDry(wet);
-  setDepth(depth);
-  setFilterType(type);
+  const StageProfiler::ScopedTimer timer(StageProfiler::updateFilters,
+                                         StageProfiler::shared);
+  if (paramValues.anyDirty(ParamIdx::filterEnvDelay, 6)) {
+    auto& env = envelopeData.filterEnv;
+    env.setDelay(paramValues[ParamIdx::filterEnvDelay]);
+    env.setAttack(paramValues[ParamIdx::filterEnvAttack]);
+    env.setHold(paramValues[ParamIdx::filterEnvHold]);
+    env.setDecay(paramValues[ParamIdx::filterEnvDecay]);
+    env.setSustain(paramValues[ParamIdx::filterEnvSustain]);
+    env.setRelease(paramValues[ParamIdx::filterEnvRelease]);
+  }
+  if (!paramValues.anyDirty(ParamIdx::filterCutoff, 5))
+    return;
+  auto& filter = patch.filter;
+  filter.cutoff = paramValues[ParamIdx::filterCutoff];
+  filter.resonance = paramValues[ParamIdx::filterResonance];
+  filter.wetDry = paramValues[ParamIdx::filterWetDry];
+  filter.depth = paramValues[ParamIdx::filterEnvDepth];
+  filter.type = (int)paramValues[ParamIdx::filterType];
+  patchChanged = true;
 }
 
 void HexSynth::updateLfosForBlock() {
+  const StageProfiler::ScopedTimer timer(StageProfiler::updateLfos,
+                                         StageProfiler::shared);
   for (int i = 0; i < NUM_LFOS; ++i) {
-    auto iStr = juce::String(i);
-    float rate = *linkedTree->getRawParameterValue(ID::lfoRate + iStr);
-    float depth = *linkedTree->getRawParameterValue(ID::lfoDepth + iStr);
-    float target = *linkedTree->getRawParameterValue(ID::lfoTarget + iStr);
-    float wave = *linkedTree->getRawParameterValue(ID::lfoWave + iStr);
-    setRate(i, rate);
-    setDepth(i, depth);
-    setTarget(i, target);
-    setLfoWave(i, wave);
+    if (!paramValues.anyDirty(ParamIdx::lfo(i, 0), ParamIdx::numLfoParams))
+      continue;
+    const auto param = [&](int p) { return paramValues[ParamIdx::lfo(i, p)]; };
+    auto& lfo = patch.lfos[(size_t)i];
+    lfo.rate = param(ParamIdx::lfoRate);
+    lfo.depth = param(ParamIdx::lfoDepth);
+    lfo.target = (int)param(ParamIdx::lfoTarget);
+    lfo.wave = (int)param(ParamIdx::lfoWave);
+    lfo.global = param(ParamIdx::lfoGlobal) > 0.0f;
+    patchChanged = true;
   }
 }
+
+void HexSynth::updateModMatrixForBlock() {
+  const StageProfiler::ScopedTimer timer(StageProfiler::updateModMatrix,
+                                         StageProfiler::shared);
+  if (!paramValues.anyDirty(
+          ParamIdx::modSlot(0, 0),
+          NUM_MOD_SLOTS * ParamIdx::numModSlotParams))
+    return;
+  ModRouteList::Slots slots;
+  for (int i = 0; i < NUM_MOD_SLOTS; ++i) {
+    const auto param = [&](int p) {
+      return paramValues[ParamIdx::modSlot(i, p)];
+    };
+    auto& slot = slots[(size_t)i];
+    slot.source = (int)param(ParamIdx::modSource);
+    slot.dest = (int)param(ParamIdx::modDest);
+    slot.depth = param(ParamIdx::modDepth);
+  }
+  patch.modRoutes = ModRouteList::compile(slots);
+  patchChanged = true;
+}
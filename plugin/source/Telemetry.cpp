@@ -0,0 +1,31 @@
+//===================================================
+#include "Audio/Telemetry.h"
+
+void Telemetry::blockFinished(juce::int64 startTicks,
+                              int numSamples,
+                              int activeVoices) {
+  if (startTicks == 0 || numSamples <= 0)
+    return;
+  const auto elapsed = juce::Time::getHighResolutionTicks() - startTicks;
+  const double seconds = juce::Time::highResolutionTicksToSeconds(elapsed);
+  const double budget = (double)numSamples / rate;
+  BlockTelemetry block;
+  block.callbackMicros = (float)(seconds * 1.0e6);
+  block.budgetPercent = (float)(100.0 * seconds / budget);
+  block.activeVoices = activeVoices;
+  if (block.budgetPercent > 100.0f)
+    xruns.fetch_add(1, std::memory_order_relaxed);
+  else if (block.budgetPercent > nearXrunPercent)
+    nearXruns.fetch_add(1, std::memory_order_relaxed);
+  const auto scope = fifo.write(1);
+  if (scope.blockSize1 > 0)
+    ring[(size_t)scope.startIndex1] = block;
+  else
+    dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Telemetry::resetCounters() {
+  nearXruns.store(0, std::memory_order_relaxed);
+  xruns.store(0, std::memory_order_relaxed);
+  dropped.store(0, std::memory_order_relaxed);
+}
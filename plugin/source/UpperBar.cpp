@@ -4,9 +4,10 @@
 #include "GUI/Fonts.h"
 #include "HexHeader.h"
 
-UpperBar::UpperBar(HexState* s, const String& verString)
-    : versionString(verString), loader(s) {
+UpperBar::UpperBar(HexState* s, Telemetry* telemetry, const String& verString)
+    : versionString(verString), loader(s), cpuMeter(telemetry) {
   addAndMakeVisible(loader);
+  addAndMakeVisible(cpuMeter);
 }
 
 void UpperBar::resized() {
@@ -15,6 +16,8 @@ void UpperBar::resized() {
   const float yScale = fBounds.getHeight() / 100.0f;
   frect_t loaderBnds = {1411.0f * xScale, 40.0f * yScale, 358.0f * xScale, 22.0f * yScale};
   loader.setBounds(loaderBnds.toNearestInt());
+  frect_t meterBnds = {1100.0f * xScale, 40.0f * yScale, 280.0f * xScale, 22.0f * yScale};
+  cpuMeter.setBounds(meterBnds.toNearestInt());
 }
 
 void UpperBar::paint(juce::Graphics& g){
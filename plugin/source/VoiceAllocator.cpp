@@ -0,0 +1,49 @@
+//===================================================
+#include "Audio/VoiceAllocator.h"
+
+VoiceAllocator::VoiceAllocator() : numFree(NUM_VOICES) {
+  // voice 0 ends up on top
+  for (int i = 0; i < NUM_VOICES; ++i)
+    freeList[(size_t)i] = NUM_VOICES - 1 - i;
+  onFreeList.fill(true);
+  for (auto& channel : noteMap)
+    channel.fill(-1);
+  voiceChannel.fill(-1);
+  voiceNote.fill(-1);
+}
+
+int VoiceAllocator::acquire() {
+  if (numFree == 0)
+    return -1;
+  const int voice = freeList[(size_t)--numFree];
+  onFreeList[(size_t)voice] = false;
+  return voice;
+}
+
+void VoiceAllocator::release(int voice) {
+  unmapNote(voice);
+  if (onFreeList[(size_t)voice])
+    return;
+  onFreeList[(size_t)voice] = true;
+  freeList[(size_t)numFree++] = voice;
+}
+
+void VoiceAllocator::mapNote(int voice, int midiChannel, int midiNoteNumber) {
+  unmapNote(voice);
+  const int channel = channelIdx(midiChannel);
+  noteMap[(size_t)channel][(size_t)midiNoteNumber] = (int8_t)voice;
+  voiceChannel[(size_t)voice] = channel;
+  voiceNote[(size_t)voice] = midiNoteNumber;
+}
+
+void VoiceAllocator::unmapNote(int voice) {
+  const int channel = voiceChannel[(size_t)voice];
+  if (channel == -1)
+    return;
+  auto& slot = noteMap[(size_t)channel][(size_t)voiceNote[(size_t)voice]];
+  // another voice may have taken the note over since
+  if (slot == voice)
+    slot = -1;
+  voiceChannel[(size_t)voice] = -1;
+  voiceNote[(size_t)voice] = -1;
+}
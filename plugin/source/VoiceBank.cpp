@@ -0,0 +1,357 @@
+//===================================================
+#include "Audio/VoiceBank.h"
+#include "Audio/StageProfiler.h"
+#include "Audio/Synthesizer.h"
+#include "Audio/VoiceLanesKernel.h"
+
+static_assert(VoiceLanes::numOperators == NUM_OPERATORS);
+static_assert(VoiceLanes::subBlockSize == VOICE_SUB_BLOCK);
+static_assert(VoiceLanes::tableSize == TABLESIZE);
+
+namespace {
+//! portable fallback for targets without SSE2/AVX2, plain loops that the
+//! compiler is free to auto-vectorise
+struct ScalarOps {
+  static constexpr int width = 4;
+  struct V {
+    float v[width];
+  };
+  struct VI {
+    // unsigned so that phase arithmetic wraps instead of overflowing
+    uint32_t v[width];
+  };
+  static V load(const float* p) {
+    V r;
+    for (int l = 0; l < width; ++l)
+      r.v[l] = p[l];
+    return r;
+  }
+  static VI loadInt(const int32_t* p) {
+    VI r;
+    for (int l = 0; l < width; ++l)
+      r.v[l] = (uint32_t)p[l];
+    return r;
+  }
+  static void store(float* p, V a) {
+    for (int l = 0; l < width; ++l)
+      p[l] = a.v[l];
+  }
+  static void storeInt(int32_t* p, VI a) {
+    for (int l = 0; l < width; ++l)
+      p[l] = (int32_t)a.v[l];
+  }
+  static V set1(float f) {
+    V r;
+    for (int l = 0; l < width; ++l)
+      r.v[l] = f;
+    return r;
+  }
+  static VI set1Int(int32_t i) {
+    VI r;
+    for (int l = 0; l < width; ++l)
+      r.v[l] = (uint32_t)i;
+    return r;
+  }
+  static V zero() { return set1(0.0f); }
+  static V add(V a, V b) {
+    for (int l = 0; l < width; ++l)
+      a.v[l] += b.v[l];
+    return a;
+  }
+  static V sub(V a, V b) {
+    for (int l = 0; l < width; ++l)
+      a.v[l] -= b.v[l];
+    return a;
+  }
+  static V mul(V a, V b) {
+    for (int l = 0; l < width; ++l)
+      a.v[l] *= b.v[l];
+    return a;
+  }
+  static V min(V a, V b) {
+    for (int l = 0; l < width; ++l)
+      a.v[l] = std::min(a.v[l], b.v[l]);
+    return a;
+  }
+  static V max(V a, V b) {
+    for (int l = 0; l < width; ++l)
+      a.v[l] = std::max(a.v[l], b.v[l]);
+    return a;
+  }
+  static VI addInt(VI a, VI b) {
+    for (int l = 0; l < width; ++l)
+      a.v[l] += b.v[l];
+    return a;
+  }
+  static VI andInt(VI a, VI b) {
+    for (int l = 0; l < width; ++l)
+      a.v[l] &= b.v[l];
+    return a;
+  }
+  template <int bits>
+  static VI shiftRight(VI a) {
+    for (int l = 0; l < width; ++l)
+      a.v[l] >>= bits;
+    return a;
+  }
+  static V toFloat(VI a) {
+    V r;
+    for (int l = 0; l < width; ++l)
+      r.v[l] = (float)(int32_t)a.v[l];
+    return r;
+  }
+  static VI toIncrement(V a) {
+    VI r;
+    for (int l = 0; l < width; ++l)
+      r.v[l] = (uint32_t)(int32_t)a.v[l];
+    return r;
+  }
+  static V gather(const float* table, VI idx) {
+    V r;
+    for (int l = 0; l < width; ++l)
+      r.v[l] = table[idx.v[l]];
+    return r;
+  }
+  static V gatherLanes(const float* const* tables, VI idx) {
+    V r;
+    for (int l = 0; l < width; ++l)
+      r.v[l] = tables[l][idx.v[l]];
+    return r;
+  }
+};
+}  // namespace
+
+void VoiceLanes::renderScalar(Data& d, int numSamples) {
+  renderLanes<ScalarOps>(d, numSamples);
+}
+//===================================================
+VoiceBank::VoiceBank()
+    : activeOps(0), laneWidth(4), maxLaneWidth(4), enabled(true) {
+#if HEX_VOICEBANK_AVX2
+  if (juce::SystemStats::hasAVX2())
+    maxLaneWidth = 8;
+#endif
+  laneWidth = maxLaneWidth;
+  // every SineOsc reads the same table
+  data.sineTable = WTArray::getSharedSine();
+  setSampleRate(44100.0);
+}
+
+void VoiceBank::setSampleRate(double rate) {
+  data.nyquist = (float)(rate / 2.0);
+  data.sampleRate = rate;
+}
+
+void VoiceBank::setLaneWidth(int width) {
+  laneWidth = (width > 4) ? maxLaneWidth : 4;
+}
+
+void VoiceBank::runKernel(int numSamples) {
+  if (laneWidth == 8) {
+    VoiceLanes::renderAVX2(data, numSamples);
+    return;
+  }
+#if JUCE_INTEL
+  VoiceLanes::renderSSE(data, numSamples);
+#else
+  VoiceLanes::renderScalar(data, numSamples);
+#endif
+}
+
+void VoiceBank::renderGroup(HexVoice** voices,
+                            int numVoices,
+                            int startSample,
+                            int numSamples) {
+  jassert(numVoices > 0 && numVoices <= laneWidth);
+  int sample = startSample;
+  const int endSample = startSample + numSamples;
+  HexVoice* playing[VoiceLanes::maxLanes];
+  while (sample < endSample) {
+    const int subBlockSize = std::min(VOICE_SUB_BLOCK, endSample - sample);
+    // voices whose audible operators have all finished are silent for the
+    // rest of the block, so they drop out of the group. A stolen note that
+    // was waiting for that starts here instead
+    int numPlaying = 0;
+    for (int v = 0; v < numVoices; ++v) {
+      voices[v]->startPendingNote();
+      if (voices[v]->anyEnvsActive())
+        playing[numPlaying++] = voices[v];
+    }
+    if (numPlaying == 0)
+      return;
+    voices = playing;
+    numVoices = numPlaying;
+    for (int v = 0; v < numVoices; ++v) {
+      voices[v]->renderEnvelopeStage(subBlockSize);
+      voices[v]->renderModulationStage(sample, subBlockSize);
+    }
+    if (loadLanes(voices, numVoices, subBlockSize)) {
+      const StageProfiler::ScopedTimer timer(StageProfiler::oscillators,
+                                             StageProfiler::shared);
+      runKernel(subBlockSize);
+      storeLanes(voices, numVoices, subBlockSize);
+    } else {
+      for (int v = 0; v < numVoices; ++v)
+        voices[v]->renderOperatorStage(subBlockSize);
+    }
+    for (int v = 0; v < numVoices; ++v)
+      voices[v]->renderPanStage(subBlockSize);
+    renderFilterStage(voices, numVoices, subBlockSize);
+    for (int v = 0; v < numVoices; ++v) {
+      voices[v]->writeOutputStage(sample, subBlockSize);
+      voices[v]->startPendingNote();
+    }
+    sample += subBlockSize;
+  }
+}
+
+void VoiceBank::renderFilterStage(HexVoice** voices,
+                                  int numVoices,
+                                  int numSamples) {
+  const StageProfiler::ScopedTimer timer(StageProfiler::filter,
+                                         StageProfiler::shared);
+  constexpr int groupSize = StereoFilter::maxGroupSize;
+  StereoFilter* filters[groupSize];
+  float* left[groupSize];
+  float* right[groupSize];
+  const float* envLevels[groupSize];
+  const float* lfoMod[groupSize];
+  // bypassed filters leave the signal alone, only group up the others
+  HexVoice* filtered[VoiceLanes::maxLanes];
+  int numFiltered = 0;
+  for (int v = 0; v < numVoices; ++v) {
+    if (!voices[v]->voiceFilter.isBypassed())
+      filtered[numFiltered++] = voices[v];
+  }
+  for (int v = 0; v < numFiltered; v += groupSize) {
+    const int count = std::min(groupSize, numFiltered - v);
+    for (int f = 0; f < count; ++f) {
+      auto* voice = filtered[v + f];
+      auto& bufs = voice->getBlockBuffers();
+      filters[f] = &voice->voiceFilter;
+      left[f] = bufs.left;
+      right[f] = bufs.right;
+      envLevels[f] = bufs.filterEnv;
+      lfoMod[f] = voice->getFilterMod();
+    }
+    StereoFilter::processGroup(filters, left, right, envLevels, lfoMod, count,
+                               numSamples);
+  }
+}
+
+bool VoiceBank::loadLanes(HexVoice** voices, int numVoices, int numSamples) {
+  // operators that are dead or silent in every voice get left out entirely,
+  // their output reads as 0 anywhere it's used
+  activeOps = 0;
+  for (int v = 0; v < numVoices; ++v)
+    activeOps |= voices[v]->getActiveOps();
+  const auto isActive = [&](int o) { return (activeOps >> o) & 1; };
+  // all the voices share the synth's modulation schedule
+  auto* schedule = voices[0]->getSchedule();
+  int numOrdered = 0;
+  int numEdges = 0;
+  for (size_t k = 0; k < NUM_OPERATORS; ++k) {
+    const int o = schedule->order[k];
+    if (!isActive(o))
+      continue;
+    data.order[numOrdered] = o;
+    data.edgeStart[numOrdered] = numEdges;
+    for (int e = schedule->edgeStart[k]; e < schedule->edgeStart[k + 1]; ++e) {
+      const int src = schedule->edges[(size_t)e].src;
+      if (isActive(src))
+        data.edgeSrc[numEdges++] = src;
+    }
+    ++numOrdered;
+  }
+  data.edgeStart[numOrdered] = numEdges;
+  data.numOrdered = numOrdered;
+  for (int o = 0; o < NUM_OPERATORS; ++o) {
+    if (!isActive(o))
+      continue;
+    bool allSine = true;
+    bool allWave = true;
+    for (int v = 0; v < numVoices; ++v) {
+      auto& osc = voices[v]->operators[o]->oscillator;
+      // the kernel only does linear interpolation
+      if (osc.getInterpolation() != OscInterpolation::linear)
+        return false;
+      allSine = allSine && osc.isSineMode();
+      allWave = allWave && osc.isWaveMode();
+    }
+    if (!allSine && !allWave)
+      return false;
+    data.modes[o] = allSine ? VoiceLanes::sineMode : VoiceLanes::waveMode;
+  }
+
+  for (int l = 0; l < laneWidth; ++l) {
+    if (l < numVoices) {
+      auto* voice = voices[l];
+      auto& bufs = voice->getBlockBuffers();
+      const double fundamental = voice->getFundamental();
+      for (int o = 0; o < NUM_OPERATORS; ++o) {
+        if (!isActive(o))
+          continue;
+        auto* op = voice->operators[o];
+        auto& osc = op->oscillator;
+        data.exactHz[o][l] = fundamental * op->getRatio();
+        if (data.modes[o] == VoiceLanes::sineMode) {
+          data.phase[o][l] = osc.getSineOsc().getPhase();
+        } else {
+          // picked once for the sub-block, where the per-voice oscillator
+          // follows the modulated pitch sample by sample. The tables only
+          // differ in their top octave of harmonics
+          auto& waveOsc = osc.getWaveOsc();
+          data.phase[o][l] = waveOsc.getPhase();
+          data.tables[o][l] = waveOsc.getTableFor(data.exactHz[o][l]);
+        }
+        data.baseHz[o][l] = (float)data.exactHz[o][l];
+        data.modIndex[o][l] = op->getModIndex();
+        data.lastOut[o][l] = op->lastMono();
+        for (int i = 0; i < numSamples; ++i) {
+          data.gain[o][i][l] = bufs.opGain[o][i];
+          data.env[o][i][l] = bufs.opEnv[o][i];
+        }
+      }
+    } else {
+      // unused lanes run silently and get thrown away
+      for (int o = 0; o < NUM_OPERATORS; ++o) {
+        if (!isActive(o))
+          continue;
+        data.phase[o][l] = 0;
+        data.baseHz[o][l] = VoiceLanes::minHz;
+        data.exactHz[o][l] = VoiceLanes::minHz;
+        data.modIndex[o][l] = 0.0f;
+        data.lastOut[o][l] = 0.0f;
+        if (data.modes[o] == VoiceLanes::waveMode)
+          data.tables[o][l] = data.tables[o][0];
+        for (int i = 0; i < numSamples; ++i) {
+          data.gain[o][i][l] = 0.0f;
+          data.env[o][i][l] = 0.0f;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void VoiceBank::storeLanes(HexVoice** voices, int numVoices, int numSamples) {
+  for (int l = 0; l < numVoices; ++l) {
+    auto& bufs = voices[l]->getBlockBuffers();
+    // the group runs every operator that's active in any of its voices, but
+    // a voice only takes back the ones it would have run itself, the same as
+    // the per-voice renderer
+    const uint32_t laneOps = voices[l]->getActiveOps();
+    for (int o = 0; o < NUM_OPERATORS; ++o) {
+      if (!((laneOps >> o) & 1))
+        continue;
+      auto* op = voices[l]->operators[o];
+      if (data.modes[o] == VoiceLanes::sineMode)
+        op->oscillator.getSineOsc().setPhase(data.phase[o][l]);
+      else
+        op->oscillator.getWaveOsc().setPhase(data.phase[o][l]);
+      op->setLastMono(data.lastOut[o][l]);
+      for (int i = 0; i < numSamples; ++i)
+        bufs.opOut[o][i] = data.out[o][i][l];
+    }
+  }
+}
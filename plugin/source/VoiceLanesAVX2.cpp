@@ -0,0 +1,73 @@
+//===================================================
+// AVX2 build of the VoiceBank operator kernel (8 voices per instruction).
+// CMake compiles only this file with AVX2 enabled and defines
+// HEX_VOICEBANK_AVX2; the VoiceBank checks the CPU before selecting it.
+// Don't include anything here besides the kernel and intrinsics headers.
+#include "Audio/VoiceLanes.h"
+
+#if HEX_VOICEBANK_AVX2
+#include <immintrin.h>
+#include "Audio/VoiceLanesKernel.h"
+
+namespace {
+struct AVX2Ops {
+  using V = __m256;
+  using VI = __m256i;
+  static constexpr int width = 8;
+  static V load(const float* p) { return _mm256_load_ps(p); }
+  static VI loadInt(const int32_t* p) {
+    return _mm256_load_si256(reinterpret_cast<const __m256i*>(p));
+  }
+  static void store(float* p, V v) { _mm256_store_ps(p, v); }
+  static void storeInt(int32_t* p, VI v) {
+    _mm256_store_si256(reinterpret_cast<__m256i*>(p), v);
+  }
+  static V set1(float f) { return _mm256_set1_ps(f); }
+  static VI set1Int(int32_t i) { return _mm256_set1_epi32(i); }
+  static V zero() { return _mm256_setzero_ps(); }
+  static V add(V a, V b) { return _mm256_add_ps(a, b); }
+  static V sub(V a, V b) { return _mm256_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm256_mul_ps(a, b); }
+  static V min(V a, V b) { return _mm256_min_ps(a, b); }
+  static V max(V a, V b) { return _mm256_max_ps(a, b); }
+  static VI addInt(VI a, VI b) { return _mm256_add_epi32(a, b); }
+  static VI andInt(VI a, VI b) { return _mm256_and_si256(a, b); }
+  template <int bits>
+  static VI shiftRight(VI a) {
+    return _mm256_srli_epi32(a, bits);
+  }
+  static V toFloat(VI a) { return _mm256_cvtepi32_ps(a); }
+  //! the kernel keeps these within +-2^31, so truncating is exact enough
+  static VI toIncrement(V a) { return _mm256_cvttps_epi32(a); }
+  static V gather(const float* table, VI idx) {
+    return _mm256_i32gather_ps(table, idx, 4);
+  }
+  //! the same with a table per lane. The tables can be anywhere in memory,
+  //! so this gathers from full 64 bit addresses, four lanes at a time
+  static V gatherLanes(const float* const* tables, VI idx) {
+    const __m256i base0 =
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(tables));
+    const __m256i base1 =
+        _mm256_load_si256(reinterpret_cast<const __m256i*>(tables + 4));
+    const __m256i offset0 = _mm256_slli_epi64(
+        _mm256_cvtepu32_epi64(_mm256_castsi256_si128(idx)), 2);
+    const __m256i offset1 = _mm256_slli_epi64(
+        _mm256_cvtepu32_epi64(_mm256_extracti128_si256(idx, 1)), 2);
+    const __m128 lo =
+        _mm256_i64gather_ps(nullptr, _mm256_add_epi64(base0, offset0), 1);
+    const __m128 hi =
+        _mm256_i64gather_ps(nullptr, _mm256_add_epi64(base1, offset1), 1);
+    return _mm256_set_m128(hi, lo);
+  }
+};
+}  // namespace
+
+void VoiceLanes::renderAVX2(Data& data, int numSamples) {
+  renderLanes<AVX2Ops>(data, numSamples);
+}
+
+#else
+void VoiceLanes::renderAVX2(Data& data, int numSamples) {
+  renderSSE(data, numSamples);
+}
+#endif
@@ -0,0 +1,64 @@
+//===================================================
+// SSE2 build of the VoiceBank operator kernel (4 voices per instruction).
+// SSE2 is the baseline on every x86-64 target so no extra flags are needed.
+#include "Audio/VoiceLanes.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#include "Audio/VoiceLanesKernel.h"
+
+namespace {
+struct SSEOps {
+  using V = __m128;
+  using VI = __m128i;
+  static constexpr int width = 4;
+  static V load(const float* p) { return _mm_load_ps(p); }
+  static VI loadInt(const int32_t* p) {
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(p));
+  }
+  static void store(float* p, V v) { _mm_store_ps(p, v); }
+  static void storeInt(int32_t* p, VI v) {
+    _mm_store_si128(reinterpret_cast<__m128i*>(p), v);
+  }
+  static V set1(float f) { return _mm_set1_ps(f); }
+  static VI set1Int(int32_t i) { return _mm_set1_epi32(i); }
+  static V zero() { return _mm_setzero_ps(); }
+  static V add(V a, V b) { return _mm_add_ps(a, b); }
+  static V sub(V a, V b) { return _mm_sub_ps(a, b); }
+  static V mul(V a, V b) { return _mm_mul_ps(a, b); }
+  static V min(V a, V b) { return _mm_min_ps(a, b); }
+  static V max(V a, V b) { return _mm_max_ps(a, b); }
+  static VI addInt(VI a, VI b) { return _mm_add_epi32(a, b); }
+  static VI andInt(VI a, VI b) { return _mm_and_si128(a, b); }
+  template <int bits>
+  static VI shiftRight(VI a) {
+    return _mm_srli_epi32(a, bits);
+  }
+  static V toFloat(VI a) { return _mm_cvtepi32_ps(a); }
+  //! the kernel keeps these within +-2^31, so truncating is exact enough
+  static VI toIncrement(V a) { return _mm_cvttps_epi32(a); }
+  static V gather(const float* table, VI idx) {
+    alignas(16) int32_t i[4];
+    storeInt(i, idx);
+    return _mm_setr_ps(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+  }
+  static V gatherLanes(const float* const* tables, VI idx) {
+    alignas(16) int32_t i[4];
+    storeInt(i, idx);
+    return _mm_setr_ps(tables[0][i[0]], tables[1][i[1]], tables[2][i[2]],
+                       tables[3][i[3]]);
+  }
+};
+}  // namespace
+
+void VoiceLanes::renderSSE(Data& data, int numSamples) {
+  renderLanes<SSEOps>(data, numSamples);
+}
+
+#else
+// not an x86 target, the VoiceBank never selects this kernel
+void VoiceLanes::renderSSE(Data& data, int numSamples) {
+  renderScalar(data, numSamples);
+}
+#endif
@@ -0,0 +1,137 @@
+//===================================================
+#include "Audio/VoiceRenderPool.h"
+#if JUCE_INTEL
+#include <emmintrin.h>
+#endif
+#include <thread>
+
+static constexpr uint64_t fieldMask = (1ull << 20) - 1;
+static constexpr uint32_t genMask = (1u << 24) - 1;
+// how long a worker busy-waits for the next block before going to sleep
+static constexpr int workerSpinCount = 4096;
+
+static uint64_t packLane(uint32_t gen, int next, int end) {
+  return ((uint64_t)(gen & genMask) << 40) | ((uint64_t)next << 20) |
+         (uint64_t)end;
+}
+
+static void spinPause() {
+#if JUCE_INTEL
+  _mm_pause();
+#else
+  std::this_thread::yield();
+#endif
+}
+//===================================================
+VoiceRenderPool::Worker::Worker(VoiceRenderPool& p, int participantIdx)
+    : juce::Thread("Hex voice worker " + juce::String(participantIdx)),
+      pool(p),
+      participant(participantIdx) {}
+
+void VoiceRenderPool::Worker::run() {
+  uint32_t seen = pool.generation.load(std::memory_order_acquire);
+  while (!threadShouldExit()) {
+    uint32_t gen = seen;
+    for (int i = 0; i < workerSpinCount && gen == seen; ++i) {
+      spinPause();
+      gen = pool.generation.load(std::memory_order_acquire);
+    }
+    if (gen == seen) {
+      // seq_cst on both sides so either run() sees this thread asleep or
+      // the wait sees the new generation
+      pool.numSleeping.fetch_add(1);
+      pool.generation.wait(seen);
+      pool.numSleeping.fetch_sub(1);
+      gen = pool.generation.load(std::memory_order_acquire);
+    }
+    if (threadShouldExit())
+      return;
+    seen = gen;
+    pool.work(participant, gen);
+  }
+}
+//===================================================
+VoiceRenderPool::VoiceRenderPool(int numWorkers,
+                                 int blockSize,
+                                 double sampleRate) {
+  numWorkers = juce::jlimit(0, maxWorkers, numWorkers);
+  numParticipants = numWorkers + 1;
+  const auto options =
+      juce::Thread::RealtimeOptions{}.withApproximateAudioProcessingTime(
+          blockSize, sampleRate);
+  for (int i = 0; i < numWorkers; ++i) {
+    auto* worker = workers.add(new Worker(*this, i + 1));
+    // fall back to a normal thread if the OS won't give us a real-time one
+    if (!worker->startRealtimeThread(options))
+      worker->startThread(juce::Thread::Priority::highest);
+  }
+}
+
+VoiceRenderPool::~VoiceRenderPool() {
+  for (auto* w : workers)
+    w->signalThreadShouldExit();
+  generation.fetch_add(1, std::memory_order_release);
+  generation.notify_all();
+  for (auto* w : workers)
+    w->stopThread(1000);
+}
+
+void VoiceRenderPool::run(int numJobs, JobFunc func, void* context) {
+  if (numJobs <= 0)
+    return;
+  // nothing to split, so don't wake anyone up for it
+  if (numJobs < minJobsToSplit || numParticipants == 1) {
+    for (int job = 0; job < numJobs; ++job)
+      func(context, job);
+    return;
+  }
+  jassert((uint64_t)numJobs <= fieldMask);
+  currentFunc = func;
+  currentContext = context;
+  jobsRemaining.store(numJobs, std::memory_order_relaxed);
+  const uint32_t gen = generation.load(std::memory_order_relaxed) + 1;
+  for (int p = 0; p < numParticipants; ++p) {
+    const int begin = (numJobs * p) / numParticipants;
+    const int end = (numJobs * (p + 1)) / numParticipants;
+    lanes[p].state.store(packLane(gen, begin, end), std::memory_order_relaxed);
+  }
+  generation.store(gen);
+  // workers that are still spinning pick the new generation up on their
+  // own, the futex wake is only needed for the ones that went to sleep
+  if (numSleeping.load() > 0)
+    generation.notify_all();
+  work(0, gen);
+  // the last few jobs may still be running on other threads
+  while (jobsRemaining.load(std::memory_order_acquire) > 0)
+    spinPause();
+}
+
+int VoiceRenderPool::claim(int lane, uint32_t gen) {
+  auto& state = lanes[lane].state;
+  uint64_t current = state.load(std::memory_order_acquire);
+  while (true) {
+    const uint32_t laneGen = (uint32_t)(current >> 40);
+    const int next = (int)((current >> 20) & fieldMask);
+    const int end = (int)(current & fieldMask);
+    if (laneGen != (gen & genMask) || next >= end)
+      return -1;
+    if (state.compare_exchange_weak(current, current + (1ull << 20),
+                                    std::memory_order_acq_rel,
+                                    std::memory_order_acquire)) {
+      return next;
+    }
+  }
+}
+
+void VoiceRenderPool::work(int participant, uint32_t gen) {
+  // own range first, then steal from everyone else's
+  for (int i = 0; i < numParticipants; ++i) {
+    const int lane = (participant + i) % numParticipants;
+    int job = claim(lane, gen);
+    while (job != -1) {
+      currentFunc(currentContext, job);
+      jobsRemaining.fetch_sub(1, std::memory_order_acq_rel);
+      job = claim(lane, gen);
+    }
+  }
+}